@@ -4,6 +4,9 @@ more off;
 m = 2000;
 n = 3000;
 bin_file = 'data/A_mat1.bin'
+% 1 = self describing column major format (mapped directly by the loaders), 
+% 0 = legacy format (int32 dims followed by row major doubles)
+new_format = 1;
 mat_file = 'data/A_mat1.mat'
  
 
@@ -30,12 +33,22 @@ M = A;
 fprintf('write matrix M\n');
 num_nnz = m*n;
 fp = fopen(bin_file,'w');
-fwrite(fp,m,'int32');
-fwrite(fp,n,'int32');
-for i=1:m
-    fprintf('writing row %d of %d\n', i,m);
-    for j=1:n
-        fwrite(fp,M(i,j),'double');
+if new_format
+    % 64 byte header: magic, version, dtype (1 = float64), 
+    % storage order (1 = column major), reserved, nrows, ncols, data offset, padding
+    fwrite(fp,['RSVDMAT' 0],'uint8');
+    fwrite(fp,[1 1 1 0],'int32');
+    fwrite(fp,[m n 64],'int64');
+    fwrite(fp,zeros(16,1),'uint8');
+    fwrite(fp,M,'double');
+else
+    fwrite(fp,m,'int32');
+    fwrite(fp,n,'int32');
+    for i=1:m
+        fprintf('writing row %d of %d\n', i,m);
+        for j=1:n
+            fwrite(fp,M(i,j),'double');
+        end
     end
 end
 fclose(fp);
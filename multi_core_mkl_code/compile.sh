@@ -1,3 +1,8 @@
 #!/bin/bash
 #icc -mkl -openmp -fpic driver_multi_core_mkl.c low_rank_svd_algorithms_intel_mkl.c matrix_vector_functions_intel_mkl.c -o driver_multi_core_mkl 
 icc -mkl -openmp driver_multi_core_mkl.c low_rank_svd_algorithms_intel_mkl.c matrix_vector_functions_intel_mkl.c -o driver_multi_core_mkl 
+icc -mkl -openmp convert_matrix_binary.c matrix_vector_functions_intel_mkl.c -o convert_matrix_binary 
+# same sources in single precision (real_t = float, sgemm and the s LAPACK routines)
+icc -mkl -openmp -DRSVD_SINGLE_PRECISION driver_multi_core_mkl.c low_rank_svd_algorithms_intel_mkl.c matrix_vector_functions_intel_mkl.c -o driver_multi_core_mkl_float 
+# 64-bit offsets on matrices with more than 2^31 entries (the dense part is skipped if it does not fit)
+icc -mkl -openmp test_large_matrix_mkl.c low_rank_svd_algorithms_intel_mkl.c matrix_vector_functions_intel_mkl.c -o test_large_matrix_mkl 
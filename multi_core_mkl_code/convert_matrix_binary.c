@@ -0,0 +1,26 @@
+/* convert a legacy binary matrix file (int dims + row major doubles) 
+ * to the self describing format read by matrix_load_from_binary_file 
+ * usage: ./convert_matrix_binary legacy.bin new.bin [col|row]
+ */
+
+#include "matrix_vector_functions_intel_mkl.h"
+
+int main(int argc, char **argv)
+{
+    int storage_order = MATRIX_FILE_COL_MAJOR;
+
+    if(argc < 3){
+        printf("usage: %s legacy.bin new.bin [col|row]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 3 && strcmp(argv[3],"row") == 0){
+        storage_order = MATRIX_FILE_ROW_MAJOR;
+    }
+
+    if(matrix_convert_legacy_binary_file(argv[1], argv[2], storage_order) != 0){
+        return 1;
+    }
+    printf("done..\n");
+
+    return 0;
+}
@@ -7,46 +7,223 @@
 
 int main()
 {
-    int i, j, m, n, k;
-    double normM,normU,normS,normV,normP,percent_error;
-    mat *M, *U, *S, *V, *P;
+    int i, j, m, n, k, p, sketch_type, estimate_error, compare_mixed_precision, benchmark_quantized;
+    int benchmark_implicit_Q, benchmark_core_solvers, solver, l;
+    int core_sizes[6] = {250, 500, 1000, 2000, 3000, 5000};
+    double core_times[7];
+    char *core_solver_names[7] = {"gesvd", "gesdd", "gesvj", "syev", "syevd", "syevr", "syevr top l/4"};
+    int widths[3] = {0, 16, 8};
+    double pass_start, pass_times[3], storage_mb[3], quantized_errors[3];
+    double time_explicit, time_implicit;
+    double normM,normU,normS,normV,percent_error;
+    double spectral_bound, frobenius_estimate, frobenius_bound;
+    double percent_error_double, percent_error_mixed;
+    mat *M, *U, *S, *V, *X, *Y, *Z;
+    mat_quantized *Mq;
+    mat *Bt, *Bt_reflectors, *Qhat, *Rhat, *Uhat, *V_explicit, *V_implicit;
+    vec *tau, *evals;
+    mat *A, *Acopy, *Ucore, *Score, *Vtcore;
     time_t start_time, end_time;
     char *M_file = "../data/A_mat1.bin";
 
+    // 64 byte aligned data; MATRIX_HUGE_PAGES_TRANSPARENT helps for large M
+    matrix_alloc_configure(64, MATRIX_HUGE_PAGES_NONE);
+    // LAPACK drivers of the small SVDs and eigendecompositions (see benchmark_core_solvers)
+    core_solvers_configure(SVD_SOLVER_GESVD, EIG_SOLVER_SYEV);
+    //core_solvers_configure(SVD_SOLVER_GESDD, EIG_SOLVER_SYEVR);
+
+    // built with -DRSVD_SINGLE_PRECISION everything below runs in float
+    printf("working precision: %s\n", RSVD_PRECISION_NAME);
     printf("loading matrix from %s\n", M_file);
     M = matrix_load_from_binary_file(M_file);
+    // sparse inputs are kept in CSR
+    //M = matrix_new_from_sparse(spmat_load_from_matrix_market_file("../data/A.mtx"));
     m = M->nrows;
     n = M->ncols;
     printf("sizes of M are %d by %d\n", m, n);
 
     // now test low rank SVD of M..
     k = 500;
+    p = 20;
+    sketch_type = SKETCH_GAUSSIAN;
+    //sketch_type = SKETCH_SRHT;
+    //sketch_type = SKETCH_SPARSE_SIGN;
+    // 1: estimate the error with 10 random probes instead of computing it
+    estimate_error = 0;
+    // 1: also report the accuracy of the float32 range finder against svd3 in double
+    compare_mixed_precision = 0;
+    // 1: time a pass over M and the accuracy of svd3 with M stored exactly, in 16 and in 8 bits
+    benchmark_quantized = 0;
+    // 1: time the QR of Bt and V = Qhat*Uhat with Qhat formed by orgqr and with Qhat kept as reflectors
+    benchmark_implicit_Q = 0;
+    // 1: time each small core solver on l x l matrices to find the crossovers
+    benchmark_core_solvers = 0;
     /*U = matrix_new(m,k);
     S = matrix_new(k,k);
     V = matrix_new(n,k);*/
     
-    printf("calling random SVD with k = %d\n", k);
+    printf("calling random SVD with k = %d and oversampling p = %d\n", k, p);
     time(&start_time);
-    //randomized_low_rank_svd1(M, k, U, S, V);
-    randomized_low_rank_svd2(M, k, &U, &S, &V);
+    //randomized_low_rank_svd1(M, k, p, &U, &S, &V);
+    randomized_low_rank_svd2(M, k, p, sketch_type, &U, &S, &V);
+    //randomized_low_rank_svd2_with_qhat(M, k, p, sketch_type, QHAT_IMPLICIT, &U, &S, &V);
+    //randomized_low_rank_svd3_with_orthogonalization(M, k, p, 2, sketch_type, ORTH_SHIFTED_CHOLESKY_QR3, ORTH_HOUSEHOLDER, QHAT_EXPLICIT, &U, &S, &V);
+    //randomized_low_rank_svd3_low_memory(M, k, p, 2, sketch_type, &U, &S, &V);
+    //randomized_low_rank_svd3_quantized(M, k, p, 2, 8, &U, &S, &V);
+    //randomized_low_rank_svd_block_krylov(M, k, p, 2, sketch_type, &U, &S, &V);
+    //lanczos_low_rank_svd(M, k, 4, LANCZOS_REORTH_ONE_SIDED, 1e-8, &U, &S, &V);
+    //randomized_low_rank_svd2_adaptive(M, 0.1, 100, &k, &U, &S, &V);
+    //randomized_low_rank_svd3_out_of_core(M_file, k, p, 2, 1000, &U, &S, &V);
+    //randomized_low_rank_svd_single_pass(M_file, k, 1000, &U, &S, &V);
+    // for repeated calls on same sized matrices plan once (U, S, V allocated as above):
+    //rsvd_plan *plan = rsvd_plan_create(m, n, k, p, 2, RSVD_SVD3); rsvd_plan_execute(plan, M, U, S, V); rsvd_plan_destroy(plan);
     time(&end_time);
     printf("elapsed time: about %d seconds\n", (int)difftime(end_time,start_time));
 
-    // form product matrix
-    P = matrix_new(m,n);
-    form_svd_product_matrix(U,S,V,P);
-
     // get norms of each
     normM = get_matrix_frobenius_norm(M);
     normU = get_matrix_frobenius_norm(U);
     normS = get_matrix_frobenius_norm(S);
     normV = get_matrix_frobenius_norm(V);
-    normP = get_matrix_frobenius_norm(P);
-    printf("normM = %f ; normU = %f ; normS = %f ; normV = %f ; normP = %f\n", normM, normU, normS, normV, normP);
+    printf("normM = %f ; normU = %f ; normS = %f ; normV = %f\n", normM, normU, normS, normV);
+
+    if(estimate_error){
+        // bounds hold with probability at least 1 - 10^-10 and 1 - 10^-3
+        estimate_svd_error(M, U, S, V, 10, 1e-3, &spectral_bound, &frobenius_estimate, &frobenius_bound);
+        printf("estimated percent_error between M and U S V^T = %f (bound %f), spectral norm of error <= %f\n", 
+            100.0*frobenius_estimate/normM, 100.0*frobenius_bound/normM, spectral_bound);
+    }
+    else{
+        // calculate percent error from panels of M, without forming P = U S V^T
+        percent_error = get_percent_error_of_svd(M,U,S,V);
+        //mat *P = matrix_new(m,n);
+        //form_svd_product_matrix(U,S,V,P);
+        //percent_error = get_percent_error_between_two_mats(M,P);
+        printf("percent_error between M and U S V^T = %f\n", percent_error);
+    }
+
+    if(compare_mixed_precision){
+        matrix_delete(U); matrix_delete(S); matrix_delete(V);
+        time(&start_time);
+        randomized_low_rank_svd3(M, k, p, 2, SKETCH_GAUSSIAN, &U, &S, &V);
+        time(&end_time);
+        percent_error_double = get_percent_error_of_svd(M,U,S,V);
+        printf("svd3 with q = 2 in double: percent_error = %f, about %d seconds\n", percent_error_double, (int)difftime(end_time,start_time));
+        matrix_delete(U); matrix_delete(S); matrix_delete(V);
+        time(&start_time);
+        randomized_low_rank_svd3_mixed_precision(M, k, p, 2, &U, &S, &V);
+        time(&end_time);
+        percent_error_mixed = get_percent_error_of_svd(M,U,S,V);
+        printf("svd3 with q = 2, float32 range finder: percent_error = %f, about %d seconds\n", percent_error_mixed, (int)difftime(end_time,start_time));
+        printf("accuracy change of mixed precision: %e percent\n", percent_error_mixed - percent_error_double);
+    }
+
+    if(benchmark_quantized){
+        // a pass is half of Y = M X, Z = M^T Y with k+p columns
+        X = matrix_new(n,k+p);
+        Y = matrix_new(m,k+p);
+        Z = matrix_new(n,k+p);
+        initialize_random_matrix(X);
+        for(i=0; i<3; i++){
+            matrix_delete(U); matrix_delete(S); matrix_delete(V);
+            if(widths[i] == 0){
+                pass_start = dsecnd();
+                matrix_matrix_mult(M,X,Y);
+                matrix_transpose_matrix_mult(M,Y,Z);
+                pass_times[i] = (dsecnd() - pass_start)/2;
+                storage_mb[i] = ((double)m)*n*sizeof(real_t)/1.0e6;
+                randomized_low_rank_svd3(M, k, p, 2, SKETCH_GAUSSIAN, &U, &S, &V);
+            }
+            else{
+                Mq = matrix_quantized_new_from_matrix(M, widths[i]);
+                pass_start = dsecnd();
+                matrix_quantized_matrix_mult(Mq,X,Y);
+                matrix_quantized_transpose_matrix_mult(Mq,Y,Z);
+                pass_times[i] = (dsecnd() - pass_start)/2;
+                storage_mb[i] = matrix_quantized_bytes(Mq)/1.0e6;
+                matrix_quantized_delete(Mq);
+                randomized_low_rank_svd3_quantized(M, k, p, 2, widths[i], &U, &S, &V);
+            }
+            quantized_errors[i] = get_percent_error_of_svd(M,U,S,V);
+        }
+        for(i=0; i<3; i++){
+            printf("M stored %s: %.1f MB, %.4f seconds per pass, svd3 with q = 2 percent_error = %f\n", 
+                widths[i] == 0 ? "exactly" : (widths[i] == 16 ? "in 16 bits" : "in 8 bits"), 
+                storage_mb[i], pass_times[i], quantized_errors[i]);
+        }
+        matrix_delete(X);
+        matrix_delete(Y);
+        matrix_delete(Z);
+    }
 
-    // calculate percent error
-    percent_error = get_percent_error_between_two_mats(M,P);
-    printf("percent_error between M and U S V^T = %f\n", percent_error);
+    if(benchmark_implicit_Q){
+        // the V stage of svd2/svd3 on an n x (k+p) Bt; the two V agree up to rounding 
+        // unless compact_QR_factorization used TSQR (then column signs may differ)
+        Bt = matrix_new(n,k+p);
+        Bt_reflectors = matrix_new(n,k+p);
+        Uhat = matrix_new(k+p,k+p);
+        initialize_random_matrix(Bt);
+        initialize_random_matrix(Uhat);
+        matrix_copy(Bt_reflectors,Bt);
+        Qhat = matrix_new(n,k+p);
+        Rhat = matrix_new(k+p,k+p);
+        tau = vector_new(k+p);
+        V_explicit = matrix_new(n,k);
+        V_implicit = matrix_new(n,k);
+
+        pass_start = dsecnd();
+        compact_QR_factorization(Bt,Qhat,Rhat);
+        matrix_matrix_mult(Qhat,Uhat,V_explicit);
+        time_explicit = dsecnd() - pass_start;
+
+        pass_start = dsecnd();
+        compact_QR_factorization_implicit(Bt_reflectors,tau,Rhat);
+        implicit_Q_matrix_mult(Bt_reflectors,tau,Uhat,V_implicit);
+        time_implicit = dsecnd() - pass_start;
+
+        printf("QR of Bt and V = Qhat*Uhat: explicit Qhat %.4f seconds (plus %.1f MB for Qhat), implicit Qhat %.4f seconds, percent difference of V %e\n", 
+            time_explicit, ((double)n)*(k+p)*sizeof(real_t)/1.0e6, time_implicit, get_percent_error_between_two_mats(V_explicit,V_implicit));
+        matrix_delete(Bt); matrix_delete(Bt_reflectors); matrix_delete(Uhat);
+        matrix_delete(Qhat); matrix_delete(Rhat); vector_delete(tau);
+        matrix_delete(V_explicit); matrix_delete(V_implicit);
+    }
+
+    if(benchmark_core_solvers){
+        // SVDs of a Gaussian l x l matrix and eigendecompositions of its Gram matrix, 
+        // up to the l = k+p of ranks in the thousands where the crossovers lie
+        for(i=0; i<6; i++){
+            l = core_sizes[i];
+            A = matrix_new(l,l);
+            Acopy = matrix_new(l,l);
+            Ucore = matrix_new(l,l);
+            Score = matrix_new(l,l);
+            Vtcore = matrix_new(l,l);
+            evals = vector_new(l);
+            initialize_random_matrix(A);
+            for(solver=0; solver<3; solver++){
+                core_solvers_configure(solver, EIG_SOLVER_SYEV);
+                matrix_copy(Acopy,A);
+                pass_start = dsecnd();
+                singular_value_decomposition(Acopy, Ucore, Score, Vtcore);
+                core_times[solver] = dsecnd() - pass_start;
+            }
+            matrix_transpose_matrix_mult(A,A,Ucore);
+            for(solver=0; solver<4; solver++){
+                core_solvers_configure(SVD_SOLVER_GESVD, min(solver, EIG_SOLVER_SYEVR));
+                matrix_copy(Acopy,Ucore);
+                pass_start = dsecnd();
+                compute_top_evals_and_evecs_of_symm_matrix(Acopy, evals, (solver == 3) ? l/4 : l);
+                core_times[3+solver] = dsecnd() - pass_start;
+            }
+            printf("core solvers for l = %d:", l);
+            for(solver=0; solver<7; solver++){
+                printf(" %s %.3f s%s", core_solver_names[solver], core_times[solver], solver < 6 ? "," : "\n");
+            }
+            matrix_delete(A); matrix_delete(Acopy); matrix_delete(Ucore);
+            matrix_delete(Score); matrix_delete(Vtcore); vector_delete(evals);
+        }
+        core_solvers_configure(SVD_SOLVER_GESVD, EIG_SOLVER_SYEV);
+    }
 
 
     // delete and exit
@@ -54,7 +231,8 @@ int main()
     matrix_delete(U);
     matrix_delete(S);
     matrix_delete(V);
-    matrix_delete(P);
+
+    matrix_alloc_print_stats();
 
     return 0;
 }
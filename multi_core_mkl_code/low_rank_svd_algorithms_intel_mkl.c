@@ -1,11 +1,13 @@
 #include "low_rank_svd_algorithms_intel_mkl.h"
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(mat *M, int k, mat **U, mat **S, mat **V){
-    int i,j,m,n;
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd1(mat *M, int k, int p, mat **U, mat **S, mat **V){
+    int i,j,m,n,l;
     double val;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // setup mats
     *U = matrix_new(m,k);
@@ -13,110 +15,238 @@ void randomized_low_rank_svd1(mat *M, int k, mat **U, mat **S, mat **V){
     *V = matrix_new(n,k);
 
     // build random matrix
-    mat *RN = matrix_new(n, k);
+    mat *RN = matrix_new(n, l);
     printf("form RN..\n");
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
+    mat *Y = matrix_new(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q..\n");
-    mat *Q = matrix_new(m,k);
-    //build_orthonormal_basis_from_mat(Y,Q);
+    mat *Q = matrix_new(m,l);
     QR_factorization_getQ(Y, Q);
 
 
-    // build the matrix B B^T = Q^T M M^T Q column by column 
-    // Bt = M^T Q ; nxm * mxk = nxk
+    // build the matrix B B^T = Q^T M M^T Q from Bt = M^T Q ; nxm * mxl = nxl 
+    // alone (B = Bt^T), so that M is only ever the first operand of a product 
+    // and a sparse M goes through its CSR and CSC copies
     printf("form BBt..\n");
-    mat *B = matrix_new(k,n);
-    matrix_transpose_matrix_mult(Q,M,B);
-
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);    
 
-    mat *BBt = matrix_new(k,k);
-    matrix_matrix_mult(B,Bt,BBt);    
+    mat *BBt = matrix_new(l,l);
+    matrix_transpose_matrix_mult(Bt,Bt,BBt);    
 
     // compute eigendecomposition of BBt
     printf("eigendecompose BBt..\n");
-    vec *evals = vector_new(k);
-    mat *Uhat = matrix_new(k, k);
+    vec *evals = vector_new(l);
+    mat *Uhat = matrix_new(l, l);
     matrix_copy_symmetric(Uhat,BBt);
-    compute_evals_and_evecs_of_symm_matrix(Uhat, evals);
+    compute_top_evals_and_evecs_of_symm_matrix(Uhat, evals, k);
 
+    // eigenvalues are in ascending order, so the top k 
+    // eigenvectors are the last k columns of Uhat
+    mat Uhat_k;
+    matrix_columns_view(&Uhat_k, Uhat, l-k, k);
 
     // compute singular values and matrix Sigma
     printf("form S..\n");
     vec *singvals = vector_new(k);
     for(i=0; i<k; i++){
-        vector_set_element(singvals,i,sqrt(vector_get_element(evals,i)));
+        vector_set_element(singvals,i,sqrt(vector_get_element(evals,l-k+i)));
     }
     initialize_diagonal_matrix(*S, singvals);
     
-    // compute U = Q*Uhat mxk * kxk = mxk  
+    // compute U = Q*Uhat_k mxl * lxk = mxk  
     printf("form U..\n");
-    matrix_matrix_mult(Q,Uhat,*U);
+    matrix_matrix_mult(Q,&Uhat_k,*U);
 
     // compute nxk V 
-    // V = B^T Uhat * Sigma^{-1}
+    // V = B^T Uhat_k * Sigma^{-1}
     printf("form V..\n");
     mat *Sinv = matrix_new(k,k);
-    mat *UhatSinv = matrix_new(k,k);
+    mat *UhatSinv = matrix_new(l,k);
     invert_diagonal_matrix(Sinv,*S);
-    matrix_matrix_mult(Uhat,Sinv,UhatSinv);
+    matrix_matrix_mult(&Uhat_k,Sinv,UhatSinv);
     matrix_matrix_mult(Bt,UhatSinv,*V);
 
     // clean up
     matrix_delete(RN);
     matrix_delete(Y);
     matrix_delete(Q);
-    matrix_delete(B);
     matrix_delete(Bt);
+    matrix_delete(BBt);
+    matrix_delete(Uhat);
+    vector_delete(evals);
+    vector_delete(singvals);
     matrix_delete(Sinv);
     matrix_delete(UhatSinv);
 }
 
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR version */
-void randomized_low_rank_svd2(mat *M, int k, mat **U, mat **S, mat **V){
-    int i,j,m,n;
-    double val;
+/* the last stage of svd2 and svd3 from the range basis Q (mxl) and Bt = M^T Q (nxl): 
+ * [Qhat,Rhat] = qr(Bt), Rhat = Uhat*S*Vhat_trans, U = Q*Vhat_trans(1:k,:)^T and 
+ * V = Qhat*Uhat(:,1:k); with QHAT_IMPLICIT Qhat stays as the reflectors in Bt */
+static void svd_from_range_basis(mat *Q, mat *Bt, int qhat_mode, mat *U, mat *S, mat *V){
+    int l;
+    mat *Qhat = NULL;
+    vec *tau = NULL;
+    l = Bt->ncols;
+
+    // compute QR factorization of Bt    
+    //M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
+    //void compact_QR_factorization(mat *M, mat *Q, mat *R)
+    printf("doing QR..\n");
+    mat *Rhat = matrix_new(l,l);   
+    if(qhat_mode == QHAT_IMPLICIT){
+        tau = vector_new(l);
+        compact_QR_factorization_implicit(Bt,tau,Rhat);
+    }
+    else{
+        Qhat = matrix_new(Bt->nrows,l);
+        compact_QR_factorization(Bt,Qhat,Rhat);
+    }
+
+    // compute SVD of Rhat (lxl), S keeps the top k singular values
+    printf("doing SVD..\n");
+    mat *Uhat = matrix_new(l,l);
+    mat *Vhat_trans = matrix_new(l,l);
+    singular_value_decomposition(Rhat, Uhat, S, Vhat_trans);
+
+    // U = Q*Vhat_trans(1:k,:)^T
+    printf("form U..\n");
+    matrix_matrix_transpose_mult(Q,Vhat_trans,U);
+
+    // V = Qhat*Uhat(:,1:k)
+    printf("form V..\n");
+    if(qhat_mode == QHAT_IMPLICIT){
+        implicit_Q_matrix_mult(Bt,tau,Uhat,V);
+        vector_delete(tau);
+    }
+    else{
+        matrix_matrix_mult(Qhat,Uhat,V);
+        matrix_delete(Qhat);
+    }
+
+    // free stuff
+    matrix_delete(Rhat);
+    matrix_delete(Uhat);
+    matrix_delete(Vhat_trans);
+}
+
+
+
+/* computes the approximate low rank SVD of rank k of matrix M using QR version 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd2(mat *M, int k, int p, int sketch_type, mat **U, mat **S, mat **V){
+    randomized_low_rank_svd2_with_qhat(M, k, p, sketch_type, QHAT_EXPLICIT, U, S, V);
+}
+
+
+void randomized_low_rank_svd2_with_qhat(mat *M, int k, int p, int sketch_type, int qhat_mode, mat **U, mat **S, mat **V){
+    int m,n,l;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // setup mats
     *U = matrix_new(m,k);
     *S = matrix_new(k,k);
     *V = matrix_new(n,k);
 
-    // build random matrix
-    printf("form RN..\n");
-    mat *RN = matrix_new(n, k);
-    initialize_random_matrix(RN);
-
-    // multiply to get matrix of random samples Y
+    // random samples Y = M*Omega of the range of M
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
-    matrix_matrix_mult(M, RN, Y);
+    mat *Y = matrix_new(m,l);
+    matrix_random_sketch_mult(M, Y, sketch_type);
 
     // build Q from Y
     printf("form Q..\n");
-    mat *Q = matrix_new(m,k);
-    //build_orthonormal_basis_from_mat(Y,Q);
+    mat *Q = matrix_new(m,l);
     QR_factorization_getQ(Y, Q);
 
-    // form Bt = Mt*Q : nxm * mxk = nxk
+    // form Bt = Mt*Q : nxm * mxl = nxl
     printf("form Bt..\n");
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);
 
+    // QR of Bt, SVD of Rhat, U and V
+    svd_from_range_basis(Q, Bt, qhat_mode, *U, *S, *V);
+
+    // free stuff
+    matrix_delete(Y);
+    matrix_delete(Q);
+    matrix_delete(Bt);
+}
+
+
+
+/* computes the approximate low rank SVD of matrix M to relative tolerance TOL 
+ * using the blocked randomized QB scheme with error indicator:
+ * Q = [Q1 .. Qi] and B^T = [Bt1 .. Bti] grow by kstep columns per step with 
+ * Qi = orth(M*RNi - Q*(B*RNi)) reorthogonalized against Q (orthonormalize_against_basis) 
+ * and Bti = M^T*Qi;
+ * since norm(M - Q*B)_F^2 = norm(M)_F^2 - norm(B)_F^2 the error is tracked 
+ * by subtracting norm(Bti)_F^2 each step (this resolves TOL down to about 1e-7) */
+void randomized_low_rank_svd2_adaptive(mat *M, double TOL, int kstep, int *frank, mat **U, mat **S, mat **V){
+    int m,n,k,b;
+    double normM_squared, error_squared, normBi;
+    m = M->nrows; n = M->ncols;
+
+    normM_squared = pow(get_matrix_frobenius_norm(M),2);
+    error_squared = normM_squared;
+
+    // Q and Bt start empty and grow a block of columns at a time
+    mat *Q = matrix_new(m,0);
+    mat *Bt = matrix_new(n,0);
+
+    k = 0;
+    while(k < min(m,n) && error_squared > TOL*TOL*normM_squared){
+        b = min(kstep, min(m,n) - k);
+
+        // random samples of what is left of the range: Yi = M*RNi - Q*(B*RNi)
+        mat *RN = matrix_new(n, b);
+        initialize_random_matrix(RN);
+        mat *Y = matrix_new(m,b);
+        matrix_matrix_mult(M, RN, Y);
+        if(k > 0){
+            mat *BRN = matrix_new(k,b);
+            matrix_transpose_matrix_mult(Bt, RN, BRN);
+            matrix_matrix_mult_sub(Q, BRN, Y);
+            matrix_delete(BRN);
+        }
+
+        // orthogonalize against the existing basis (BCGS2) and within the block
+        mat *Qi = matrix_new(m,b);
+        matrix_copy(Qi, Y);
+        orthonormalize_against_basis(Q, Qi, ORTH_HOUSEHOLDER);
+
+        // Bti = M^T*Qi and update of the error indicator
+        mat *Bti = matrix_new(n,b);
+        matrix_transpose_matrix_mult(M, Qi, Bti);
+        normBi = get_matrix_frobenius_norm(Bti);
+        error_squared -= normBi*normBi;
+
+        matrix_append_columns(Q, Qi);
+        matrix_append_columns(Bt, Bti);
+        k += b;
+        printf("rank %d: relative error indicator %f\n", k, sqrt(max(error_squared,0)/normM_squared));
+
+        matrix_delete(RN);
+        matrix_delete(Y);
+        matrix_delete(Qi);
+        matrix_delete(Bti);
+    }
+    *frank = k;
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
     // compute QR factorization of Bt    
-    //M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
-    //void compact_QR_factorization(mat *M, mat *Q, mat *R)
     printf("doing QR..\n");
     mat *Qhat = matrix_new(n,k);
     mat *Rhat = matrix_new(k,k);   
@@ -137,49 +267,50 @@ void randomized_low_rank_svd2(mat *M, int k, mat **U, mat **S, mat **V){
     matrix_matrix_mult(Qhat,Uhat,*V);
 
     // free stuff
-    matrix_delete(RN);
-    matrix_delete(Y);
     matrix_delete(Q);
+    matrix_delete(Bt);
     matrix_delete(Rhat);
     matrix_delete(Qhat);
     matrix_delete(Uhat);
     matrix_delete(Vhat_trans);
-    matrix_delete(Bt);
 }
 
 
 
 /* computes the approximate low rank SVD of rank k of matrix M using QR version 
- * with range sampling via (M M^T)^q M R*/
-void randomized_low_rank_svd3(mat *M, int k, int q, mat **U, mat **S, mat **V){
-    int i,j,m,n;
-    double val;
+ * with range sampling via (M M^T)^q M R with k+p random samples 
+ * (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd3(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V){
+    randomized_low_rank_svd3_with_orthogonalization(M, k, p, q, sketch_type, ORTH_HOUSEHOLDER, ORTH_HOUSEHOLDER, QHAT_EXPLICIT, U, S, V);
+}
+
+
+void randomized_low_rank_svd3_with_orthogonalization(mat *M, int k, int p, int q, int sketch_type, 
+    int orth_power, int orth_final, int qhat_mode, mat **U, mat **S, mat **V){
+    int j,m,n,l;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // setup mats
     *U = matrix_new(m,k);
     *S = matrix_new(k,k);
     *V = matrix_new(n,k);
 
-    // build random matrix
-    mat *RN = matrix_new(n, k);
-    initialize_random_matrix(RN);
-
-    // multiply to get matrix of random samples Y
+    // random samples Y = M*Omega of the range of M
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
-    matrix_matrix_mult(M, RN, Y);
+    mat *Y = matrix_new(m,l);
+    matrix_random_sketch_mult(M, Y, sketch_type);
 
-    // build Q from Y
+    // build Q from Y, the final basis already when there is no power iteration
     printf("form Q with q=%d..\n",q);
-    mat *Q = matrix_new(m,k);
-    //build_orthonormal_basis_from_mat(Y,Q);
-    QR_factorization_getQ(Y, Q);
+    mat *Q = matrix_new(m,l);
+    orthonormalize(Y, Q, (q > 0) ? orth_power : orth_final);
 
     // now refine Q
-    mat *Z = matrix_new(m,k);
-    Y = matrix_new(n,k);
-    mat *W = matrix_new(n,k);
+    matrix_delete(Y);
+    mat *Z = matrix_new(m,l);
+    Y = matrix_new(n,l);
+    mat *W = matrix_new(n,l);
     for(j=0; j<q; j++){
         printf("in loop for j=%d of %d\n", j, q);
         printf("M is %d x %d and Q is %d x %d and Y is %d x %d\n", M->nrows, M->ncols, Q->nrows, Q->ncols, Y->nrows, Y->ncols);
@@ -188,7 +319,7 @@ void randomized_low_rank_svd3(mat *M, int k, int q, mat **U, mat **S, mat **V){
         printf("Y is %d x %d\n", Y->nrows, Y->ncols);
         if( j%2 == 0 ){
             printf("orthogonalize Y..\n");
-            QR_factorization_getQ(Y, W);
+            orthonormalize(Y, W, orth_power);
             printf("Z = M*W..\n");
             matrix_matrix_mult(M,W,Z);
         }
@@ -198,45 +329,773 @@ void randomized_low_rank_svd3(mat *M, int k, int q, mat **U, mat **S, mat **V){
         }
         if( j%2 == 0 ){
             printf("orthogonalize Z..\n");
-            QR_factorization_getQ(Z, Q);
+            orthonormalize(Z, Q, orth_power);
         }
     }
 
-    // orthogonalize on exit from loop
-    QR_factorization_getQ(Z, Q);
+    // orthogonalize on exit from loop (Z is only formed when q > 0)
+    if(q > 0){
+        orthonormalize(Z, Q, orth_final);
+    }
 
-    // form Bt = Mt*Q : nxm * mxk = nxk
+    // form Bt = Mt*Q : nxm * mxl = nxl
     printf("form Bt..\n");
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);
 
+    // QR of Bt, SVD of Rhat, U and V
+    svd_from_range_basis(Q, Bt, qhat_mode, *U, *S, *V);
+
+    // free stuff
+    matrix_delete(Y);
+    matrix_delete(Q);
+    matrix_delete(Z);
+    matrix_delete(W);
+    matrix_delete(Bt);
+}
+
+
+/* svd3 with the passes over M of the range finder in single precision */
+void randomized_low_rank_svd3_mixed_precision(mat *M, int k, int p, int q, mat **U, mat **S, mat **V){
+    int j,m,n,l;
+    m = M->nrows; n = M->ncols;
+    l = k + p;
+
+    if(M->sp != NULL){
+        printf("sparse M: using svd3 in double\n");
+        randomized_low_rank_svd3(M, k, p, q, SKETCH_GAUSSIAN, U, S, V);
+        return;
+    }
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    printf("form float32 shadow of M..\n");
+    mat_float *Mf = matrix_float_new(m,n);
+    matrix_float_from_double(Mf, M);
+
+    // random samples Y = M*RN in single precision
+    printf("form Y..\n");
+    mat_float *RNf = matrix_float_new(n,l);
+    initialize_random_matrix_float(RNf);
+    mat_float *Yf = matrix_float_new(m,l);
+    matrix_float_matrix_mult(Mf, RNf, Yf);
+    matrix_float_delete(RNf);
+
+    // widen and orthogonalize in double
+    printf("form Q with q=%d..\n",q);
+    mat *Y = matrix_new(m,l);
+    mat *Q = matrix_new(m,l);
+    matrix_double_from_float(Y, Yf);
+    QR_factorization_getQ(Y, Q);
+
+    // power iteration W = orth(M^T Q), Q = orth(M W) with the products 
+    // in single precision
+    mat *W = matrix_new(n,l);
+    mat *Z = matrix_new(n,l);
+    mat_float *Wf = matrix_float_new(n,l);
+    mat_float *Qf = matrix_float_new(m,l);
+    for(j=0; j<q; j++){
+        printf("in loop for j=%d of %d\n", j, q);
+        matrix_float_from_double(Qf, Q);
+        matrix_float_transpose_matrix_mult(Mf, Qf, Wf);
+        matrix_double_from_float(Z, Wf);
+        QR_factorization_getQ(Z, W);
+        matrix_float_from_double(Wf, W);
+        matrix_float_matrix_mult(Mf, Wf, Yf);
+        matrix_double_from_float(Y, Yf);
+        QR_factorization_getQ(Y, Q);
+    }
+    matrix_float_delete(Mf);
+    matrix_float_delete(Yf);
+    matrix_float_delete(Wf);
+    matrix_float_delete(Qf);
+    matrix_delete(W);
+    matrix_delete(Z);
+    matrix_delete(Y);
+
+    // form Bt = Mt*Q : nxm * mxl = nxl, in double
+    printf("form Bt..\n");
+    mat *Bt = matrix_new(n,l);
+    matrix_transpose_matrix_mult(M,Q,Bt);
+
+    // QR of Bt, SVD of Rhat, U and V as in svd3
+    svd_from_range_basis(Q, Bt, QHAT_EXPLICIT, *U, *S, *V);
+
+    // free stuff
+    matrix_delete(Q);
+    matrix_delete(Bt);
+}
+
+
+void randomized_low_rank_svd3_quantized(mat *M, int k, int p, int q, int bits, mat **U, mat **S, mat **V){
+    int j,m,n,l;
+    m = M->nrows; n = M->ncols;
+    l = k + p;
+
+    if(M->sp != NULL){
+        printf("sparse M: using svd3 without quantization\n");
+        randomized_low_rank_svd3(M, k, p, q, SKETCH_GAUSSIAN, U, S, V);
+        return;
+    }
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    mat_quantized *Mq = matrix_quantized_new_from_matrix(M, bits);
+    printf("quantized M to %d bits: %.1f MB, relative error %e\n", Mq->bits, 
+        matrix_quantized_bytes(Mq)/1.0e6, matrix_quantized_relative_error(Mq, M));
+
+    // random samples Y = Mq*RN
+    printf("form Y..\n");
+    mat *RN = matrix_new(n,l);
+    initialize_random_matrix(RN);
+    mat *Y = matrix_new(m,l);
+    matrix_quantized_matrix_mult(Mq, RN, Y);
+    matrix_delete(RN);
+
+    printf("form Q with q=%d..\n",q);
+    mat *Q = matrix_new(m,l);
+    QR_factorization_getQ(Y, Q);
+
+    // power iteration W = orth(Mq^T Q), Q = orth(Mq W) 
+    mat *W = matrix_new(n,l);
+    mat *Z = matrix_new(n,l);
+    for(j=0; j<q; j++){
+        printf("in loop for j=%d of %d\n", j, q);
+        matrix_quantized_transpose_matrix_mult(Mq, Q, Z);
+        QR_factorization_getQ(Z, W);
+        matrix_quantized_matrix_mult(Mq, W, Y);
+        QR_factorization_getQ(Y, Q);
+    }
+    matrix_quantized_delete(Mq);
+    matrix_delete(W);
+    matrix_delete(Z);
+    matrix_delete(Y);
+
+    // form Bt = Mt*Q : nxm * mxl = nxl, with the exact M
+    printf("form Bt..\n");
+    mat *Bt = matrix_new(n,l);
+    matrix_transpose_matrix_mult(M,Q,Bt);
+
+    // QR of Bt, SVD of Rhat, U and V as in svd3
+    svd_from_range_basis(Q, Bt, QHAT_EXPLICIT, *U, *S, *V);
+
+    // free stuff
+    matrix_delete(Q);
+    matrix_delete(Bt);
+}
+
+
+/* low memory svd3: two buffers, Q (mxl) and W (nxl), hold in turn the samples, 
+ * the bases of the power iteration, Bt, Qhat and finally U and V */
+void randomized_low_rank_svd3_low_memory(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V){
+    int j,m,n,l;
+    size_t bytes_in_use_at_start;
+    double peak_formula;
+    m = M->nrows; n = M->ncols;
+    l = k + p;
+
+    matrix_alloc_reset_peak();
+    bytes_in_use_at_start = matrix_alloc_get_stats().bytes_in_use;
+    peak_formula = ((double)m + n)*l + 2.0*l*l + ((double)min(IN_PLACE_BLOCK_ROWS,m))*k + ((double)k)*k;
+    printf("low memory svd3: peak (m+n)*l + 2*l^2 + %d*k + k^2 = %.0f entries = %.1f MB beyond M\n", 
+        min(IN_PLACE_BLOCK_ROWS,m), peak_formula, peak_formula*sizeof(real_t)/1.0e6);
+
+    // random samples Y = M*Omega, orthogonalized in place to Q
+    printf("form Q with q=%d..\n",q);
+    mat *Q = matrix_new(m,l);
+    matrix_random_sketch_mult(M, Q, sketch_type);
+    QR_factorization_getQ_in_place(Q);
+
+    // power iteration: W = orth(M^T Q), Q = orth(M W)
+    mat *W = matrix_new(n,l);
+    for(j=0; j<q; j++){
+        printf("in loop for j=%d of %d\n", j, q);
+        matrix_transpose_matrix_mult(M, Q, W);
+        QR_factorization_getQ_in_place(W);
+        matrix_matrix_mult(M, W, Q);
+        QR_factorization_getQ_in_place(Q);
+    }
+
+    // Bt = M^T*Q in W, then [Qhat,Rhat] = qr(Bt) with Qhat overwriting it
+    printf("form Bt and do QR..\n");
+    matrix_transpose_matrix_mult(M, Q, W);
+    mat *Rhat = matrix_new(l,l);
+    compact_QR_factorization_in_place(W, Rhat);
+
+    // Rhat = Uhat*diag(svals)*Vhat_trans with Uhat overwriting Rhat
+    printf("doing SVD..\n");
+    vec *svals = vector_new(l);
+    mat *Vhat_trans = matrix_new(l,l);
+    singular_value_decomposition_in_place(Rhat, svals, Vhat_trans);
+    *S = matrix_new(k,k);
+    initialize_diagonal_matrix(*S, svals);
+
+    // U = Q*Vhat_trans(1:k,:)^T and V = Qhat*Uhat(:,1:k), in place
+    printf("form U and V..\n");
+    matrix_matrix_mult_in_place(Q, Vhat_trans, k, 1);
+    matrix_matrix_mult_in_place(W, Rhat, k, 0);
+    *U = Q;
+    *V = W;
+
+    printf("low memory svd3: measured peak %.1f MB beyond M\n", 
+        (matrix_alloc_get_stats().peak_bytes_in_use - bytes_in_use_at_start)/1.0e6);
+
+    // free stuff
+    matrix_delete(Rhat);
+    matrix_delete(Vhat_trans);
+    vector_delete(svals);
+}
+
+
+/* create a plan for repeated svd1/svd2/svd3 calls on mxn matrices: all the 
+ * intermediate matrices and the LAPACK workspace are allocated here, once */
+rsvd_plan * rsvd_plan_create(int m, int n, int k, int p, int q, int algorithm){
+    int l, lwork;
+    rsvd_plan *plan = malloc(sizeof(rsvd_plan));
+    l = k + p;
+    plan->m = m; plan->n = n; plan->k = k; plan->p = p; plan->q = q; plan->l = l;
+    plan->algorithm = algorithm;
+
+    plan->RN = matrix_new(n,l);
+    plan->Y = matrix_new(m,l);
+    plan->Q = matrix_new(m,l);
+    plan->Bt = matrix_new(n,l);
+    plan->tau = vector_new(l);
+    plan->svals = vector_new(l);
+    plan->Z = NULL; plan->W = NULL;
+    plan->Qhat = NULL; plan->Rhat = NULL; plan->Uhat = NULL; plan->Vhat_trans = NULL;
+    plan->BBt = NULL; plan->UhatSinv = NULL;
+
+    // workspace queries for every LAPACK call made by execute
+    lwork = QR_factorization_workspace_size(m,l);
+    if(algorithm == RSVD_SVD1){
+        plan->BBt = matrix_new(l,l);
+        plan->UhatSinv = matrix_new(l,k);
+        lwork = max(lwork, symmetric_eigendecomposition_workspace_size(l));
+    }
+    else{
+        plan->Qhat = matrix_new(n,l);
+        plan->Rhat = matrix_new(l,l);
+        plan->Uhat = matrix_new(l,l);
+        plan->Vhat_trans = matrix_new(l,l);
+        lwork = max(lwork, QR_factorization_workspace_size(n,l));
+        lwork = max(lwork, singular_value_decomposition_workspace_size(l,l));
+    }
+    if(algorithm == RSVD_SVD3){
+        plan->Z = matrix_new(m,l);
+        plan->W = matrix_new(n,l);
+    }
+    plan->lwork = lwork;
+    plan->work = matrix_data_alloc(lwork);
+
+    printf("rsvd plan for svd%d of %d x %d with k = %d, p = %d, q = %d: LAPACK workspace of %d entries\n", 
+        algorithm, m, n, k, p, q, lwork);
+    return plan;
+}
+
+
+/* run the planned algorithm on M (of the planned size, Gaussian sketch) into the 
+ * caller owned U (mxk), S (kxk) and V (nxk); no heap allocation for dense M */
+void rsvd_plan_execute(rsvd_plan *plan, mat *M, mat *U, mat *S, mat *V){
+    int i,j,k,l;
+    double sigma;
+    mat Uhat_k;
+    k = plan->k; l = plan->l;
+
+    // random samples Y = M*RN and their orthonormal basis Q
+    initialize_random_matrix(plan->RN);
+    matrix_matrix_mult(M, plan->RN, plan->Y);
+    QR_factorization_getQ_with_work(plan->Y, plan->Q, plan->tau, plan->work, plan->lwork);
+
+    if(plan->algorithm == RSVD_SVD3){
+        // power iteration as in svd3, Bt is the nxl sample buffer
+        for(j=0; j<plan->q; j++){
+            matrix_transpose_matrix_mult(M, plan->Q, plan->Bt);
+            if( j%2 == 0 ){
+                QR_factorization_getQ_with_work(plan->Bt, plan->W, plan->tau, plan->work, plan->lwork);
+                matrix_matrix_mult(M, plan->W, plan->Z);
+                QR_factorization_getQ_with_work(plan->Z, plan->Q, plan->tau, plan->work, plan->lwork);
+            }
+            else{
+                matrix_matrix_mult(M, plan->Bt, plan->Z);
+            }
+        }
+        if(plan->q > 0){
+            QR_factorization_getQ_with_work(plan->Z, plan->Q, plan->tau, plan->work, plan->lwork);
+        }
+    }
+
+    // Bt = M^T*Q : nxl
+    matrix_transpose_matrix_mult(M, plan->Q, plan->Bt);
+
+    if(plan->algorithm == RSVD_SVD1){
+        // eigendecomposition of B B^T = Bt^T Bt, the top k eigenvectors 
+        // are the last k columns
+        matrix_transpose_matrix_mult(plan->Bt, plan->Bt, plan->BBt);
+        compute_evals_and_evecs_of_symm_matrix_with_work(plan->BBt, plan->svals, plan->work, plan->lwork);
+        matrix_columns_view(&Uhat_k, plan->BBt, l-k, k);
+
+        // S = sqrt(evals), U = Q*Uhat_k and V = Bt*Uhat_k*S^{-1}
+        for(i=0; i<k; i++){
+            sigma = sqrt(vector_get_element(plan->svals,l-k+i));
+            matrix_set_element(S,i,i,sigma);
+            for(j=0; j<l; j++){
+                matrix_set_element(plan->UhatSinv,j,i,matrix_get_element(&Uhat_k,j,i)/sigma);
+            }
+        }
+        matrix_matrix_mult(plan->Q, &Uhat_k, U);
+        matrix_matrix_mult(plan->Bt, plan->UhatSinv, V);
+    }
+    else{
+        // [Qhat,Rhat] = qr(Bt) and the SVD of Rhat, truncated to rank k
+        compact_QR_factorization_with_work(plan->Bt, plan->Qhat, plan->Rhat, plan->tau, plan->work, plan->lwork);
+        singular_value_decomposition_with_work(plan->Rhat, plan->Uhat, plan->svals, plan->Vhat_trans, plan->work, plan->lwork);
+        initialize_diagonal_matrix(S, plan->svals);
+
+        // U = Q*Vhat_trans(1:k,:)^T and V = Qhat*Uhat(:,1:k)
+        matrix_matrix_transpose_mult(plan->Q, plan->Vhat_trans, U);
+        matrix_matrix_mult(plan->Qhat, plan->Uhat, V);
+    }
+}
+
+
+void rsvd_plan_destroy(rsvd_plan *plan){
+    matrix_delete(plan->RN);
+    matrix_delete(plan->Y);
+    matrix_delete(plan->Q);
+    matrix_delete(plan->Bt);
+    vector_delete(plan->tau);
+    vector_delete(plan->svals);
+    if(plan->Z != NULL){
+        matrix_delete(plan->Z);
+        matrix_delete(plan->W);
+    }
+    if(plan->Qhat != NULL){
+        matrix_delete(plan->Qhat);
+        matrix_delete(plan->Rhat);
+        matrix_delete(plan->Uhat);
+        matrix_delete(plan->Vhat_trans);
+    }
+    if(plan->BBt != NULL){
+        matrix_delete(plan->BBt);
+        matrix_delete(plan->UhatSinv);
+    }
+    matrix_data_free(plan->work);
+    free(plan);
+}
+
+
+/* computes the approximate low rank SVD of rank k of matrix M using block Krylov 
+ * version: with l = k+p the whole Krylov space K = [M R, (M M^T) M R, ..., (M M^T)^q M R] 
+ * of (q+1)l columns is kept, each new block orthogonalized against the previous 
+ * ones (block Gram-Schmidt, two passes) and the top k triplets are extracted by 
+ * Rayleigh-Ritz on K, i.e. from the SVD of K^T M; 2q+2 passes over M as svd3 */
+void randomized_low_rank_svd_block_krylov(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V){
+    int j,t,m,n,l,b;
+    mat Ki, Kprev, Bti;
+    m = M->nrows; n = M->ncols;
+    l = k + p;
+
+    // the Krylov space can not have more than min(m,n) columns
+    while( (q+1)*l > min(m,n) && q > 0 ){
+        q--;
+    }
+    b = (q+1)*l;
+    printf("Krylov space of %d blocks of size %d\n", q+1, l);
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    // K holds the orthonormal Krylov basis block by block and 
+    // Bt = M^T K is filled in along the way
+    mat *K = matrix_new(m,b);
+    mat *Bt = matrix_new(n,b);
+    mat *Y = matrix_new(m,l);
+    mat *W = matrix_new(n,l);
+
+    // random samples Y = M*Omega of the range of M
+    printf("form Y..\n");
+    matrix_random_sketch_mult(M, Y, sketch_type);
+
+    // first block of K
+    matrix_columns_view(&Ki, K, 0, l);
+    QR_factorization_getQ(Y, &Ki);
+
+    for(j=1; j<=q; j++){
+        printf("Krylov block %d of %d..\n", j, q);
+
+        // M^T K_{j-1} is block j-1 of Bt, orthogonalize it and apply M
+        matrix_columns_view(&Bti, Bt, (j-1)*l, l);
+        matrix_transpose_matrix_mult(M, &Ki, &Bti);
+        QR_factorization_getQ(&Bti, W);
+        matrix_matrix_mult(M, W, Y);
+
+        // orthogonalize against K_0..K_{j-1}, twice for stability
+        matrix_columns_view(&Kprev, K, 0, j*l);
+        mat *C = matrix_new(j*l, l);
+        for(t=0; t<2; t++){
+            matrix_transpose_matrix_mult(&Kprev, Y, C);
+            matrix_matrix_mult_sub(&Kprev, C, Y);
+        }
+        matrix_delete(C);
+
+        matrix_columns_view(&Ki, K, j*l, l);
+        QR_factorization_getQ(Y, &Ki);
+    }
+
+    // last block of Bt = M^T K
+    printf("form Bt..\n");
+    matrix_columns_view(&Bti, Bt, q*l, l);
+    matrix_transpose_matrix_mult(M, &Ki, &Bti);
+
     // compute QR factorization of Bt    
-    //M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
-    //void compact_QR_factorization(mat *M, mat *Q, mat *R)
     printf("doing QR..\n");
-    mat *Qhat = matrix_new(n,k);
-    mat *Rhat = matrix_new(k,k);   
+    mat *Qhat = matrix_new(n,b);
+    mat *Rhat = matrix_new(b,b);   
     compact_QR_factorization(Bt,Qhat,Rhat);
 
-    // compute SVD of Rhat (kxk)
+    // compute SVD of Rhat (bxb), S keeps the top k singular values
     printf("doing SVD..\n");
-    mat *Uhat = matrix_new(k,k);
-    mat *Vhat_trans = matrix_new(k,k);
+    mat *Uhat = matrix_new(b,b);
+    mat *Vhat_trans = matrix_new(b,b);
     singular_value_decomposition(Rhat, Uhat, *S, Vhat_trans);
 
-    // U = Q*Vhat_trans
+    // U = K*Vhat_trans(1:k,:)^T
     printf("form U..\n");
-    matrix_matrix_transpose_mult(Q,Vhat_trans,*U);
+    matrix_matrix_transpose_mult(K,Vhat_trans,*U);
 
-    // V = Qhat*Uhat
+    // V = Qhat*Uhat(:,1:k)
     printf("form V..\n");
     matrix_matrix_mult(Qhat,Uhat,*V);
 
     // free stuff
-    matrix_delete(RN);
+    matrix_delete(K);
+    matrix_delete(Bt);
     matrix_delete(Y);
+    matrix_delete(W);
+    matrix_delete(Rhat);
+    matrix_delete(Qhat);
+    matrix_delete(Uhat);
+    matrix_delete(Vhat_trans);
+}
+
+
+/* Y = M*X for a block X of b columns; matrix_vector_mult when b = 1 */
+static void lanczos_block_mult(mat *M, mat *X, mat *Y){
+    if(X->ncols == 1){
+        vec x = {X->nrows, X->d}, y = {Y->nrows, Y->d};
+        matrix_vector_mult(M, &x, &y);
+    }
+    else{
+        matrix_matrix_mult(M, X, Y);
+    }
+}
+
+
+/* Y = M^T*X for a block X of b columns; matrix_transpose_vector_mult when b = 1 */
+static void lanczos_block_transpose_mult(mat *M, mat *X, mat *Y){
+    if(X->ncols == 1){
+        vec x = {X->nrows, X->d}, y = {Y->nrows, Y->d};
+        matrix_transpose_vector_mult(M, &x, &y);
+    }
+    else{
+        matrix_transpose_matrix_mult(M, X, Y);
+    }
+}
+
+
+/* computes the top k singular triplets of M by block Golub-Kahan-Lanczos 
+ * bidiagonalization with thick restart: with blocks of b columns, 
+ * M P = Q B and M^T Q = P B^T + P_next R e^T are built up to dim columns; the 
+ * SVD of the small B gives Ritz triplets, and on restart the best ones are 
+ * kept and B becomes diag(sigma) with a coupling block to P_next */
+void lanczos_low_rank_svd(mat *M, int k, int b, int reorth, double TOL, mat **U, mat **S, mat **V){
+    int i,c,t,m,n,j,kk,dim,iter,converged;
+    double res,res_max;
+    mat Pb, Pj, Qb, Qj, Pnext;
+    m = M->nrows; n = M->ncols;
+
+    // basis size: room for k Ritz vectors plus a few blocks
+    dim = k + max(k, 4*b);
+    dim = min(dim, min(m,n));
+    if(dim < k + 2*b){
+        printf("lanczos_low_rank_svd: k + 2b must not exceed min(m,n)\n");
+        *U = *S = *V = NULL;
+        return;
+    }
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    mat *P = matrix_new(n, dim + b);
+    mat *Q = matrix_new(m, dim);
+    mat *B = matrix_new(dim, dim);
+    mat *Z = matrix_new(m, b);
+    mat *W = matrix_new(n, b);
+    mat *Rb = matrix_new(b, b);
+    mat *Rw = matrix_new(b, b);
+
+    // random orthonormal start block
+    mat *RN = matrix_new(n, b);
+    initialize_random_matrix(RN);
+    matrix_columns_view(&Pb, P, 0, b);
+    QR_factorization_getQ(RN, &Pb);
+    matrix_delete(RN);
+
+    j = 0;
+    converged = 0;
+    for(iter=0; iter<LANCZOS_MAX_RESTARTS && !converged; iter++){
+
+        // extend the bidiagonalization from j to dim columns
+        while(j + b <= dim){
+            // Z = M*P_j minus its components along Q(:,1:j)
+            matrix_columns_view(&Pb, P, j, b);
+            lanczos_block_mult(M, &Pb, Z);
+            if(j > 0){
+                matrix_columns_view(&Qj, Q, 0, j);
+                mat *C = matrix_new(j, b);
+                mat *Bc = matrix_new(j, b);
+                if(reorth == LANCZOS_REORTH_FULL){
+                    // project against all of Q, twice, and record the coefficients
+                    for(t=0; t<2; t++){
+                        matrix_transpose_matrix_mult(&Qj, Z, C);
+                        matrix_matrix_mult_sub(&Qj, C, Z);
+                        matrix_add(Bc, C);
+                    }
+                }
+                else{
+                    // only the known coupling of P_j to the previous Q vectors
+                    for(i=0; i<j; i++){
+                        for(c=0; c<b; c++){
+                            matrix_set_element(Bc, i, c, matrix_get_element(B, i, j+c));
+                        }
+                    }
+                    matrix_matrix_mult_sub(&Qj, Bc, Z);
+                }
+                for(i=0; i<j; i++){
+                    for(c=0; c<b; c++){
+                        matrix_set_element(B, i, j+c, matrix_get_element(Bc, i, c));
+                    }
+                }
+                matrix_delete(C);
+                matrix_delete(Bc);
+            }
+            matrix_columns_view(&Qb, Q, j, b);
+            compact_QR_factorization(Z, &Qb, Rb);
+            for(i=0; i<b; i++){
+                for(c=0; c<b; c++){
+                    matrix_set_element(B, j+i, j+c, matrix_get_element(Rb, i, c));
+                }
+            }
+            j += b;
+
+            // W = M^T*Q_j, always reorthogonalized against all of P
+            lanczos_block_transpose_mult(M, &Qb, W);
+            matrix_columns_view(&Pj, P, 0, j);
+            mat *C = matrix_new(j, b);
+            for(t=0; t<2; t++){
+                matrix_transpose_matrix_mult(&Pj, W, C);
+                matrix_matrix_mult_sub(&Pj, C, W);
+            }
+            matrix_delete(C);
+            matrix_columns_view(&Pb, P, j, b);
+            compact_QR_factorization(W, &Pb, Rw);
+
+            // coupling Q_j^T M P_{j+1} = Rw^T
+            if(j + b <= dim){
+                for(i=0; i<b; i++){
+                    for(c=0; c<b; c++){
+                        matrix_set_element(B, j-b+i, j+c, matrix_get_element(Rw, c, i));
+                    }
+                }
+            }
+        }
+
+        // SVD of the j x j projected matrix B
+        mat *Bj = matrix_new(j, j);
+        mat *Ub = matrix_new(j, j);
+        mat *Sb = matrix_new(j, j);
+        mat *Vbt = matrix_new(j, j);
+        for(i=0; i<j; i++){
+            for(c=0; c<j; c++){
+                matrix_set_element(Bj, i, c, matrix_get_element(B, i, c));
+            }
+        }
+        singular_value_decomposition(Bj, Ub, Sb, Vbt);
+
+        // residual of Ritz triplet i is ||Rw * Ub(j-b:j-1, i)||
+        res_max = 0;
+        for(i=0; i<k; i++){
+            res = 0;
+            for(c=0; c<b; c++){
+                double r = 0;
+                for(t=c; t<b; t++){
+                    r += matrix_get_element(Rw, c, t)*matrix_get_element(Ub, j-b+t, i);
+                }
+                res += r*r;
+            }
+            res = sqrt(res);
+            if(res > res_max){
+                res_max = res;
+            }
+        }
+        printf("restart %d: max residual of top %d Ritz triplets = %e (sigma_1 = %f)\n", iter, k, res_max, matrix_get_element(Sb,0,0));
+        converged = (res_max <= TOL*matrix_get_element(Sb,0,0));
+
+        if(converged || iter == LANCZOS_MAX_RESTARTS-1){
+            // U = Q*Ub(:,1:k), V = P*Vbt(1:k,:)^T
+            matrix_columns_view(&Qj, Q, 0, j);
+            matrix_columns_view(&Pj, P, 0, j);
+            matrix_matrix_mult(&Qj, Ub, *U);
+            matrix_matrix_transpose_mult(&Pj, Vbt, *V);
+            for(i=0; i<k; i++){
+                matrix_set_element(*S, i, i, matrix_get_element(Sb, i, i));
+            }
+        }
+        else{
+            // thick restart keeping kk Ritz vectors
+            kk = min(j - b, k + b);
+            mat *Pk = matrix_new(n, kk);
+            mat *Qk = matrix_new(m, kk);
+            matrix_columns_view(&Qj, Q, 0, j);
+            matrix_columns_view(&Pj, P, 0, j);
+            matrix_matrix_mult(&Qj, Ub, Qk);
+            matrix_matrix_transpose_mult(&Pj, Vbt, Pk);
+            memcpy(Q->d, Qk->d, ((size_t)m)*kk*sizeof(real_t));
+            memcpy(P->d, Pk->d, ((size_t)n)*kk*sizeof(real_t));
+            matrix_delete(Pk);
+            matrix_delete(Qk);
+
+            // the pending block P_next moves to columns kk..kk+b-1
+            matrix_columns_view(&Pnext, P, j, b);
+            memcpy(P->d + ((size_t)n)*kk, Pnext.d, ((size_t)n)*b*sizeof(real_t));
+
+            // B = [diag(sigma_1..sigma_kk) C^T] with C = Rw*Ub(j-b:j-1,1:kk)
+            memset(B->d, 0, ((size_t)dim)*dim*sizeof(real_t));
+            for(i=0; i<kk; i++){
+                matrix_set_element(B, i, i, matrix_get_element(Sb, i, i));
+                for(c=0; c<b; c++){
+                    double r = 0;
+                    for(t=c; t<b; t++){
+                        r += matrix_get_element(Rw, c, t)*matrix_get_element(Ub, j-b+t, i);
+                    }
+                    matrix_set_element(B, i, kk+c, r);
+                }
+            }
+            j = kk;
+        }
+
+        matrix_delete(Bj);
+        matrix_delete(Ub);
+        matrix_delete(Sb);
+        matrix_delete(Vbt);
+    }
+
+    // free stuff
+    matrix_delete(P);
     matrix_delete(Q);
+    matrix_delete(B);
     matrix_delete(Z);
+    matrix_delete(W);
+    matrix_delete(Rb);
+    matrix_delete(Rw);
+}
+
+
+
+
+
+/* computes the approximate low rank SVD of rank k of the matrix stored in binary file M_file 
+ * without loading it, with range sampling via (M M^T)^q M R as in svd3: 
+ * M is only touched through M*X and M^T*X, each accumulated over panels in one 
+ * sequential pass over the file */
+void randomized_low_rank_svd3_out_of_core(char *M_file, int k, int p, int q, int panel_size, mat **U, mat **S, mat **V){
+    int j,m,n,l,num_passes=0;
+    matrix_file_stream *MS;
+
+    MS = matrix_file_stream_open(M_file, panel_size);
+    if(MS == NULL){
+        *U = *S = *V = NULL;
+        return;
+    }
+    m = MS->header.nrows; n = MS->header.ncols;
+    l = k + p;
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    // build random matrix
+    printf("form RN..\n");
+    mat *RN = matrix_new(n, l);
+    initialize_random_matrix(RN);
+
+    // multiply to get matrix of random samples Y
+    printf("form Y (pass %d)..\n", ++num_passes);
+    mat *Y = matrix_new(m,l);
+    matrix_file_stream_mult(MS, RN, Y);
+    matrix_delete(RN);
+
+    // build Q from Y
+    printf("form Q with q=%d..\n",q);
+    mat *Q = matrix_new(m,l);
+    QR_factorization_getQ(Y, Q);
+    matrix_delete(Y);
+
+    // now refine Q with orthogonalized power iterations
+    mat *Z = matrix_new(m,l);
+    mat *W = matrix_new(n,l);
+    mat *Bt = matrix_new(n,l);
+    for(j=0; j<q; j++){
+        printf("in loop for j=%d of %d\n", j, q);
+        printf("Bt = M^T*Q (pass %d)..\n", ++num_passes);
+        matrix_file_stream_transpose_mult(MS, Q, Bt);
+        QR_factorization_getQ(Bt, W);
+        printf("Z = M*W (pass %d)..\n", ++num_passes);
+        matrix_file_stream_mult(MS, W, Z);
+        QR_factorization_getQ(Z, Q);
+    }
+    matrix_delete(Z);
+    matrix_delete(W);
+
+    // form Bt = Mt*Q : nxm * mxl = nxl
+    printf("form Bt (pass %d)..\n", ++num_passes);
+    matrix_file_stream_transpose_mult(MS, Q, Bt);
+    matrix_file_stream_close(MS);
+
+    // compute QR factorization of Bt    
+    printf("doing QR..\n");
+    mat *Qhat = matrix_new(n,l);
+    mat *Rhat = matrix_new(l,l);   
+    compact_QR_factorization(Bt,Qhat,Rhat);
+
+    // compute SVD of Rhat (lxl), S keeps the top k singular values
+    printf("doing SVD..\n");
+    mat *Uhat = matrix_new(l,l);
+    mat *Vhat_trans = matrix_new(l,l);
+    singular_value_decomposition(Rhat, Uhat, *S, Vhat_trans);
+
+    // U = Q*Vhat_trans(1:k,:)^T
+    printf("form U..\n");
+    matrix_matrix_transpose_mult(Q,Vhat_trans,*U);
+
+    // V = Qhat*Uhat(:,1:k)
+    printf("form V..\n");
+    matrix_matrix_mult(Qhat,Uhat,*V);
+
+    // free stuff
+    matrix_delete(Q);
     matrix_delete(Rhat);
     matrix_delete(Qhat);
     matrix_delete(Uhat);
@@ -245,3 +1104,93 @@ void randomized_low_rank_svd3(mat *M, int k, int q, mat **U, mat **S, mat **V){
 }
 
 
+
+/* computes the approximate low rank SVD of rank k of the matrix in binary file M_file 
+ * (or stdin for "-") reading it exactly once: 
+ * Y = M*RN (mxr) and Wt = (Psi*M)^T (nxs) are accumulated panel by panel with
+ * r = 2k+1 and s = 2r+1; then with Q = orth(Y) the small factor X = (Psi*Q)^+ W 
+ * satisfies M ~ Q*X and its SVD gives the factors, as in the QR version */
+void randomized_low_rank_svd_single_pass(char *M_file, int k, int panel_size, mat **U, mat **S, mat **V){
+    int m,n,r,s;
+    matrix_file_stream *MS;
+
+    MS = matrix_file_stream_open(M_file, panel_size);
+    if(MS == NULL){
+        *U = *S = *V = NULL;
+        return;
+    }
+    m = MS->header.nrows; n = MS->header.ncols;
+    r = min(2*k + 1, min(m,n));
+    s = min(2*r + 1, m);
+    printf("sketch sizes r = %d and s = %d\n", r, s);
+
+    // setup mats
+    *U = matrix_new(m,k);
+    *S = matrix_new(k,k);
+    *V = matrix_new(n,k);
+
+    // build random test matrices for both sides
+    printf("form RN and Psi..\n");
+    mat *RN = matrix_new(n, r);
+    mat *PsiT = matrix_new(m, s);
+    initialize_random_matrix(RN);
+    initialize_random_matrix(PsiT);
+
+    // the only pass over M: Y = M*RN and Wt = M^T*Psi^T
+    printf("form Y and W in a single pass..\n");
+    mat *Y = matrix_new(m,r);
+    mat *Wt = matrix_new(n,s);
+    matrix_file_stream_two_sided_mult(MS, RN, Y, PsiT, Wt);
+    matrix_file_stream_close(MS);
+    matrix_delete(RN);
+
+    // build Q from Y
+    printf("form Q..\n");
+    mat *Q = matrix_new(m,r);
+    QR_factorization_getQ(Y, Q);
+    matrix_delete(Y);
+
+    // least squares X = (Psi*Q)^+ W via Psi*Q = Qp*Rp: Xt = Wt*Qp*Rp^{-T}
+    printf("form X..\n");
+    mat *PsiQ = matrix_new(s,r);
+    mat *Qp = matrix_new(s,r);
+    mat *Rp = matrix_new(r,r);
+    matrix_transpose_matrix_mult(PsiT, Q, PsiQ);
+    compact_QR_factorization(PsiQ, Qp, Rp);
+    mat *Xt = matrix_new(n,r);
+    matrix_matrix_mult(Wt, Qp, Xt);
+    matrix_upper_triangular_right_solve(Rp, Xt, 1);
+    matrix_delete(PsiT);
+    matrix_delete(Wt);
+    matrix_delete(PsiQ);
+    matrix_delete(Qp);
+    matrix_delete(Rp);
+
+    // compute QR factorization of Xt    
+    printf("doing QR..\n");
+    mat *Qhat = matrix_new(n,r);
+    mat *Rhat = matrix_new(r,r);   
+    compact_QR_factorization(Xt,Qhat,Rhat);
+    matrix_delete(Xt);
+
+    // compute SVD of Rhat (rxr), S keeps the top k singular values
+    printf("doing SVD..\n");
+    mat *Uhat = matrix_new(r,r);
+    mat *Vhat_trans = matrix_new(r,r);
+    singular_value_decomposition(Rhat, Uhat, *S, Vhat_trans);
+
+    // U = Q*Vhat_trans(1:k,:)^T
+    printf("form U..\n");
+    matrix_matrix_transpose_mult(Q,Vhat_trans,*U);
+
+    // V = Qhat*Uhat(:,1:k)
+    printf("form V..\n");
+    matrix_matrix_mult(Qhat,Uhat,*V);
+
+    // free stuff
+    matrix_delete(Q);
+    matrix_delete(Rhat);
+    matrix_delete(Qhat);
+    matrix_delete(Uhat);
+    matrix_delete(Vhat_trans);
+}
@@ -1,15 +1,145 @@
 #include "matrix_vector_functions_intel_mkl.h"
 
+/* reorthogonalization of the Lanczos bidiagonalization: LANCZOS_REORTH_ONE_SIDED 
+ * reorthogonalizes only the right vectors P against each other (the left vectors 
+ * only against the known coupling), LANCZOS_REORTH_FULL both P and Q */
+#define LANCZOS_REORTH_ONE_SIDED 0
+#define LANCZOS_REORTH_FULL 1
+#define LANCZOS_MAX_RESTARTS 100
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(mat *M, int k, mat **U, mat **S, mat **V);
+/* Qhat of the QR of Bt = M^T Q in svd2 and svd3: QHAT_EXPLICIT forms it 
+ * (compact_QR_factorization, TSQR for a tall Bt), QHAT_IMPLICIT keeps it as 
+ * the Householder reflectors left in Bt by one geqrf and applies them with 
+ * ormqr (compact_QR_factorization_implicit), saving the orgqr pass and the 
+ * nx(k+p) Qhat; svd2 and svd3 use QHAT_EXPLICIT */
+#define QHAT_EXPLICIT 0
+#define QHAT_IMPLICIT 1
 
+/* algorithms of an rsvd_plan */
+#define RSVD_SVD1 1
+#define RSVD_SVD2 2
+#define RSVD_SVD3 3
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR version */
-void randomized_low_rank_svd2(mat *M, int k, mat **U, mat **S, mat **V);
+
+/* preallocated state for repeated randomized SVDs of same sized matrices */
+typedef struct {
+    int m, n, k, p, q, l, algorithm;
+    mat *RN, *Y, *Q, *Bt;                   /* test matrix, samples, basis, M^T Q */
+    mat *Z, *W;                             /* power iteration (svd3) */
+    mat *Qhat, *Rhat, *Uhat, *Vhat_trans;   /* QR of Bt and SVD of Rhat (svd2, svd3) */
+    mat *BBt, *UhatSinv;                    /* eigendecomposition of B B^T (svd1) */
+    vec *tau, *svals;
+    real_t *work;                           /* LAPACK workspace of lwork entries */
+    int lwork;
+} rsvd_plan;
+
+
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version; 
+ * the range is sampled with k+p random vectors (p is the oversampling, typically 
+ * 5 to 20) and the result is truncated to rank k */
+void randomized_low_rank_svd1(mat *M, int k, int p, mat **U, mat **S, mat **V);
+
+
+/* computes the approximate low rank SVD of rank k of matrix M using QR version 
+ * with k+p random samples truncated to rank k; sketch_type selects the test 
+ * matrix (SKETCH_GAUSSIAN, SKETCH_SRHT or SKETCH_SPARSE_SIGN, 
+ * see matrix_random_sketch_mult) */
+void randomized_low_rank_svd2(mat *M, int k, int p, int sketch_type, mat **U, mat **S, mat **V);
+
+
+/* svd2 with Qhat formed or kept as reflectors, qhat_mode QHAT_EXPLICIT or QHAT_IMPLICIT */
+void randomized_low_rank_svd2_with_qhat(mat *M, int k, int p, int sketch_type, int qhat_mode, mat **U, mat **S, mat **V);
+
+
+/* computes the approximate low rank SVD of matrix M to relative tolerance TOL, i.e.
+ * norm(M - U S V^T)_F <= TOL*norm(M)_F, finding the rank adaptively by growing 
+ * the basis kstep columns at a time; the rank found is returned in frank */
+void randomized_low_rank_svd2_adaptive(mat *M, double TOL, int kstep, int *frank, mat **U, mat **S, mat **V);
 
 
 /* computes the approximate low rank SVD of rank k of matrix M using QR version 
- * with range sampling via (M M^T)^q M R*/
-void randomized_low_rank_svd3(mat *M, int k, int q, mat **U, mat **S, mat **V);
+ * with range sampling via (M M^T)^q M R with k+p random samples truncated to rank k; 
+ * sketch_type selects the test matrix R as in svd2 */
+void randomized_low_rank_svd3(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V);
+
+
+/* svd3 with the orthonormalization chosen per stage (ORTH_HOUSEHOLDER, 
+ * ORTH_CHOLESKY_QR2 or ORTH_SHIFTED_CHOLESKY_QR3, see orthonormalize): orth_power 
+ * for the bases inside the power iteration, which only need to be well conditioned, 
+ * and orth_final for the basis Q that M is projected on, and qhat_mode (QHAT_EXPLICIT 
+ * or QHAT_IMPLICIT) for the QR of Bt; svd3 uses Householder for both and QHAT_EXPLICIT */
+void randomized_low_rank_svd3_with_orthogonalization(mat *M, int k, int p, int q, int sketch_type, 
+    int orth_power, int orth_final, int qhat_mode, mat **U, mat **S, mat **V);
+
+
+/* plan repeated calls of algorithm RSVD_SVD1, RSVD_SVD2 or RSVD_SVD3 (q power 
+ * iterations, ignored otherwise) on mxn matrices with rank k and oversampling p: 
+ * allocates every intermediate and queries the LAPACK workspace once, so that 
+ * rsvd_plan_execute does no heap allocation (for dense M; it uses a Gaussian sketch). 
+ * The small SVD and eigendecomposition always run gesvd and syev here, whatever 
+ * core_solvers_configure selected: the workspace is sized for those two, and 
+ * gesdd, syevd and syevr would also need integer workspace (and syevr an lxl 
+ * output matrix) that the plan does not hold */
+rsvd_plan * rsvd_plan_create(int m, int n, int k, int p, int q, int algorithm);
+
+
+/* U (mxk), S (kxk) and V (nxk) are allocated by the caller and overwritten */
+void rsvd_plan_execute(rsvd_plan *plan, mat *M, mat *U, mat *S, mat *V);
+
+
+void rsvd_plan_destroy(rsvd_plan *plan);
+
+
+/* mixed precision svd3: the range finder (M*RN and the q power iterations) runs 
+ * with sgemm on a float32 shadow of M, each sample block is widened and 
+ * orthogonalized in double, and only Bt = M^T Q and the small factorizations 
+ * are done in double; the shadow costs mn floats and M must be dense */
+void randomized_low_rank_svd3_mixed_precision(mat *M, int k, int p, int q, mat **U, mat **S, mat **V);
+
+
+/* svd3 with the range finder (M*RN and the 2q power iteration passes) on a copy 
+ * of M quantized to bits = 8 or 16 bits per entry (see matrix_quantized_new_from_matrix), 
+ * cutting the bytes streamed per pass by 8x or 4x (4x or 2x in single precision); 
+ * the quantization error only perturbs the basis Q, since the final projection 
+ * Bt = M^T Q uses the exact M. M must be dense */
+void randomized_low_rank_svd3_quantized(mat *M, int k, int p, int q, int bits, mat **U, mat **S, mat **V);
+
+
+/* low memory version of svd3 (q = 0 gives svd2): every factorization overwrites 
+ * its input and the buffers are reused between stages, the q power iterations 
+ * orthogonalize after every product; with l = k+p the peak beyond M is about 
+ *     (m+n)*l + 2*l^2 + IN_PLACE_BLOCK_ROWS*k + k^2 entries 
+ * (the mxl and nxl buffers end up holding U and V), plus LAPACK workspace; 
+ * the formula and the peak measured by the allocator are printed */
+void randomized_low_rank_svd3_low_memory(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V);
+
+
+/* computes the approximate low rank SVD of rank k of matrix M using block Krylov 
+ * version: keeps the whole space [M R, (M M^T) M R, ..., (M M^T)^q M R] with k+p 
+ * columns per block and extracts the top k triplets by Rayleigh-Ritz; same number 
+ * of passes over M as svd3 for a given q but more accurate on slowly decaying spectra */
+void randomized_low_rank_svd_block_krylov(mat *M, int k, int p, int q, int sketch_type, mat **U, mat **S, mat **V);
+
+
+/* computes the top k singular triplets of M by block Golub-Kahan-Lanczos 
+ * bidiagonalization with thick restart, with blocks of b columns (b = 1 is the 
+ * classical single vector method) and reorthogonalization reorth; restarts until 
+ * the residuals of the top k Ritz triplets are below TOL*sigma_1 (or 
+ * LANCZOS_MAX_RESTARTS); U, S, V are returned as in svd2. Needs k + 2b <= min(m,n) 
+ * and is usually cheaper than svd3 in products with M when k << min(m,n) */
+void lanczos_low_rank_svd(mat *M, int k, int b, int reorth, double TOL, mat **U, mat **S, mat **V);
+
+
+
+/* computes the approximate low rank SVD of rank k of the matrix stored in binary file M_file 
+ * without loading it, with range sampling via (M M^T)^q M R as in svd3: 
+ * M is streamed from disk in panels of panel_size rows (columns for column major files) 
+ * in 2q+2 sequential passes with k+p random samples; peak memory is O((m+n)(k+p) + panel) */
+void randomized_low_rank_svd3_out_of_core(char *M_file, int k, int p, int q, int panel_size, mat **U, mat **S, mat **V);
+
 
+/* computes the approximate low rank SVD of rank k of the matrix in binary file M_file 
+ * (or stdin for "-") reading it exactly once, in panels of panel_size rows (columns 
+ * for column major files): keeps the range sketch Y = M*RN and the co-range sketch 
+ * W = Psi*M and reconstructs U, S, V from the sketches alone */
+void randomized_low_rank_svd_single_pass(char *M_file, int k, int panel_size, mat **U, mat **S, mat **V);
@@ -3,14 +3,215 @@
 #include "matrix_vector_functions_intel_mkl.h"
 
 
+/* allocator state; every block is preceded by a prefix recording how it was 
+ * obtained, the data starts alloc_alignment bytes after the start of the block */
+typedef struct {
+    void *base;         /* start of the block */
+    size_t length;      /* length of the block */
+    size_t bytes;       /* bytes requested */
+    int kind;           /* MATRIX_HUGE_PAGES_* actually used */
+} matrix_alloc_prefix;
+
+static size_t alloc_alignment = MATRIX_ALIGNMENT;
+static int alloc_huge_pages = MATRIX_HUGE_PAGES;
+static int core_svd_solver = SVD_SOLVER_GESVD;
+static int core_eig_solver = EIG_SOLVER_SYEV;
+static matrix_alloc_stats alloc_stats = {0,0,0,0,0,0,0};
+
+
+/* set the alignment (a power of two, at least 64) and huge page mode of the allocator; 
+ * the data pointer keeps its prefix pointer just below it, so an alignment that is not 
+ * a power of two of at least sizeof(void*) would misalign real_t data: exits instead */
+void matrix_alloc_configure(size_t alignment, int huge_pages){
+    if(alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0 || 
+        huge_pages < MATRIX_HUGE_PAGES_NONE || huge_pages > MATRIX_HUGE_PAGES_EXPLICIT){
+        fprintf(stderr, "matrix_alloc_configure: invalid alignment %zu (must be a power of two, at least %zu) or huge page mode %d\n", 
+            alignment, sizeof(void*), huge_pages);
+        exit(EXIT_FAILURE);
+    }
+    alloc_alignment = max(alignment, 64);
+    alloc_huge_pages = huge_pages;
+}
+
+
+void core_solvers_configure(int svd_solver, int eig_solver){
+    core_svd_solver = svd_solver;
+    core_eig_solver = eig_solver;
+}
+
+
+/* allocate zeroed bytes with the configured alignment and huge page mode */
+static void * matrix_bytes_alloc(size_t bytes){
+    size_t length, i;
+    char *base = NULL;
+    int kind = alloc_huge_pages;
+    matrix_alloc_prefix *prefix;
+    char *d;
+
+    length = bytes + alloc_alignment;
+
+    // small blocks are not worth a huge page
+    if(length < MATRIX_HUGE_PAGE_SIZE){
+        kind = MATRIX_HUGE_PAGES_NONE;
+    }
+
+    if(kind == MATRIX_HUGE_PAGES_EXPLICIT){
+        // reserved pages of the hugetlbfs pool, falls back if the pool is empty
+        length = (length + MATRIX_HUGE_PAGE_SIZE - 1)/MATRIX_HUGE_PAGE_SIZE*MATRIX_HUGE_PAGE_SIZE;
+        base = (char*)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if(base == MAP_FAILED){
+            base = NULL;
+            kind = MATRIX_HUGE_PAGES_TRANSPARENT;
+            alloc_stats.num_huge_page_fallbacks++;
+        }
+    }
+    if(kind == MATRIX_HUGE_PAGES_TRANSPARENT){
+        // 2 MB aligned so that the kernel can back it with transparent huge pages
+        length = (length + MATRIX_HUGE_PAGE_SIZE - 1)/MATRIX_HUGE_PAGE_SIZE*MATRIX_HUGE_PAGE_SIZE;
+        if(posix_memalign((void**)&base, MATRIX_HUGE_PAGE_SIZE, length) != 0){
+            base = NULL;
+        }
+        else{
+            madvise(base, length, MADV_HUGEPAGE);
+        }
+    }
+    if(base == NULL){
+        kind = MATRIX_HUGE_PAGES_NONE;
+        length = bytes + alloc_alignment;
+        if(posix_memalign((void**)&base, alloc_alignment, length) != 0){
+            printf("could not allocate %zu bytes\n", bytes);
+            return NULL;
+        }
+    }
+
+    prefix = (matrix_alloc_prefix*)base;
+    prefix->base = base;
+    prefix->length = length;
+    prefix->bytes = bytes;
+    prefix->kind = kind;
+    d = base + alloc_alignment;
+    ((matrix_alloc_prefix**)d)[-1] = prefix;
+
+    // first touch in parallel, one 4 KB page at a time with the same static split 
+    // as the element loops, so pages are placed near the threads that use them
+    if(bytes >= MATRIX_PARALLEL_TOUCH_MIN_BYTES){
+        #pragma omp parallel shared(d,bytes) private(i) 
+        {
+        #pragma omp for schedule(static)
+        for(i=0; i<bytes; i+=4096){
+            memset(d + i, 0, min(4096, bytes - i));
+        }
+        }
+    }
+    else{
+        memset(d, 0, bytes);
+    }
+
+    #pragma omp critical (matrix_alloc_stats)
+    {
+    alloc_stats.num_allocs++;
+    alloc_stats.bytes_allocated += bytes;
+    alloc_stats.bytes_in_use += bytes;
+    alloc_stats.peak_bytes_in_use = max(alloc_stats.peak_bytes_in_use, alloc_stats.bytes_in_use);
+    if(kind != MATRIX_HUGE_PAGES_NONE){
+        alloc_stats.num_huge_page_allocs++;
+    }
+    }
+
+    return d;
+}
+
+
+/* allocate count zeroed entries of the working precision */
+real_t * matrix_data_alloc(size_t count){
+    return (real_t*)matrix_bytes_alloc(count*sizeof(real_t));
+}
+
+
+/* free data from matrix_data_alloc */
+void matrix_data_free(void *d){
+    matrix_alloc_prefix *prefix;
+    if(d == NULL){
+        return;
+    }
+    prefix = ((matrix_alloc_prefix**)d)[-1];
+
+    #pragma omp critical (matrix_alloc_stats)
+    {
+    alloc_stats.num_frees++;
+    alloc_stats.bytes_in_use -= prefix->bytes;
+    }
+
+    if(prefix->kind == MATRIX_HUGE_PAGES_EXPLICIT){
+        munmap(prefix->base, prefix->length);
+    }
+    else{
+        free(prefix->base);
+    }
+}
+
+
+/* grow (or shrink) data from matrix_data_alloc, keeping the first min(old,new) entries */
+real_t * matrix_data_realloc(real_t *d, size_t count){
+    real_t *d_new = matrix_data_alloc(count);
+    if(d != NULL){
+        matrix_alloc_prefix *prefix = ((matrix_alloc_prefix**)d)[-1];
+        memcpy(d_new, d, min(prefix->bytes, count*sizeof(real_t)));
+        matrix_data_free(d);
+    }
+    return d_new;
+}
+
+
+/* entries allocated for data from matrix_data_alloc, at least what its matrix uses */
+size_t matrix_data_capacity(real_t *d){
+    if(d == NULL){
+        return 0;
+    }
+    return (((matrix_alloc_prefix**)d)[-1])->bytes/sizeof(real_t);
+}
+
+
+/* get the allocation statistics */
+matrix_alloc_stats matrix_alloc_get_stats(){
+    matrix_alloc_stats stats;
+    #pragma omp critical (matrix_alloc_stats)
+    {
+    stats = alloc_stats;
+    }
+    return stats;
+}
+
+
+/* restart the peak from what is in use now, to measure the peak of one computation */
+void matrix_alloc_reset_peak(){
+    #pragma omp critical (matrix_alloc_stats)
+    {
+    alloc_stats.peak_bytes_in_use = alloc_stats.bytes_in_use;
+    }
+}
+
+
+/* print the allocation statistics */
+void matrix_alloc_print_stats(){
+    printf("allocations: %zu allocs, %zu frees, %.1f MB allocated in total, %.1f MB in use, %.1f MB peak, %zu on huge pages (%zu huge page fallbacks)\n", 
+        alloc_stats.num_allocs, alloc_stats.num_frees, alloc_stats.bytes_allocated/1.0e6, 
+        alloc_stats.bytes_in_use/1.0e6, alloc_stats.peak_bytes_in_use/1.0e6, 
+        alloc_stats.num_huge_page_allocs, alloc_stats.num_huge_page_fallbacks);
+}
+
+
 /* initialize new matrix and set all entries to zero */
 mat * matrix_new(int nrows, int ncols)
 {
     mat *M = malloc(sizeof(mat));
-    //M->d = (double*)mkl_calloc(nrows*ncols, sizeof(double), 64);
-    M->d = (double*)calloc(nrows*ncols, sizeof(double));
+    M->d = matrix_data_alloc(((size_t)nrows)*ncols);
     M->nrows = nrows;
     M->ncols = ncols;
+    M->mapping = NULL;
+    M->mapping_length = 0;
+    M->sp = NULL;
+    M->spt = NULL;
     return M;
 }
 
@@ -19,8 +220,7 @@ mat * matrix_new(int nrows, int ncols)
 vec * vector_new(int nrows)
 {
     vec *v = malloc(sizeof(vec));
-    //v->d = (double*)mkl_calloc(nrows,sizeof(double), 64);
-    v->d = (double*)calloc(nrows,sizeof(double));
+    v->d = matrix_data_alloc(nrows);
     v->nrows = nrows;
     return v;
 }
@@ -28,29 +228,74 @@ vec * vector_new(int nrows)
 
 void matrix_delete(mat *M)
 {
-    //mkl_free(M->d);
-    free(M->d);
+    if(M->sp != NULL){
+        spmat_delete(M->sp);
+        spmat_delete(M->spt);
+    }
+    if(M->mapping != NULL){
+        munmap(M->mapping, M->mapping_length);
+    }
+    else{
+        matrix_data_free(M->d);
+    }
     free(M);
 }
 
 
 void vector_delete(vec *v)
 {
-    //mkl_free(v->d);
-    free(v->d);
+    matrix_data_free(v->d);
     free(v);
 }
 
 
+/* initialize new nrows x ncols sparse matrix with room for nnz nonzeros */
+spmat * spmat_new(int nrows, int ncols, int64_t nnz)
+{
+    spmat *A = malloc(sizeof(spmat));
+    A->row_ptr = (int64_t*)calloc(nrows+1, sizeof(int64_t));
+    A->col_ind = (int*)calloc(nnz, sizeof(int));
+    A->d = (real_t*)calloc(nnz, sizeof(real_t));
+    A->nrows = nrows;
+    A->ncols = ncols;
+    A->nnz = nnz;
+    return A;
+}
+
+
+void spmat_delete(spmat *A)
+{
+    free(A->row_ptr);
+    free(A->col_ind);
+    free(A->d);
+    free(A);
+}
+
+
+/* wrap the sparse A as a mat together with its CSC form */
+mat * matrix_new_from_sparse(spmat *A)
+{
+    mat *M = malloc(sizeof(mat));
+    M->d = NULL;
+    M->nrows = A->nrows;
+    M->ncols = A->ncols;
+    M->mapping = NULL;
+    M->mapping_length = 0;
+    M->sp = A;
+    M->spt = spmat_transpose(A);
+    return M;
+}
+
+
 // column major format
 void matrix_set_element(mat *M, int row_num, int col_num, double val){
     //M->d[row_num*(M->ncols) + col_num] = val;
-    M->d[col_num*(M->nrows) + row_num] = val;
+    M->d[((size_t)col_num)*(M->nrows) + row_num] = val;
 }
 
 double matrix_get_element(mat *M, int row_num, int col_num){
     //return M->d[row_num*(M->ncols) + col_num];
-    return M->d[col_num*(M->nrows) + row_num];
+    return M->d[((size_t)col_num)*(M->nrows) + row_num];
 }
 
 
@@ -64,44 +309,652 @@ double vector_get_element(vec *v, int row_num){
 }
 
 
+/* bytes per entry of a payload of MATRIX_FILE_DTYPE_* dtype, 0 if unsupported */
+static size_t matrix_file_dtype_size(int dtype){
+    if(dtype == MATRIX_FILE_DTYPE_FLOAT64){
+        return sizeof(double);
+    }
+    if(dtype == MATRIX_FILE_DTYPE_FLOAT32){
+        return sizeof(float);
+    }
+    return 0;
+}
+
+
+/* 0 if the header describes a nonempty payload of dtype_size byte entries that lies 
+ * within a file of file_size bytes, compared without overflow; -1 otherwise */
+static int matrix_file_check_payload_size(matrix_file_header *header, size_t dtype_size, size_t file_size){
+    if(header->nrows <= 0 || header->ncols <= 0 || dtype_size == 0 || 
+        header->data_offset < 0 || (uint64_t)header->data_offset > file_size){
+        return -1;
+    }
+    if((uint64_t)header->nrows > (file_size - header->data_offset)/dtype_size/header->ncols){
+        return -1;
+    }
+    return 0;
+}
+
+
+/* convert count contiguous entries of a payload of the given dtype into the working precision */
+static void matrix_convert_payload(real_t *dst, const char *src, size_t count, int dtype){
+    size_t i;
+    if(dtype == MATRIX_FILE_DTYPE_FLOAT64){
+        const double *s = (const double*)src;
+        for(i=0; i<count; i++){
+            dst[i] = s[i];
+        }
+    }
+    else{
+        const float *s = (const float*)src;
+        for(i=0; i<count; i++){
+            dst[i] = s[i];
+        }
+    }
+}
+
+
+/* fill column major M from a row major payload of the given dtype with a cache 
+ * blocked transpose, converting to the working precision inside each tile; 
+ * tiles of TRANSPOSE_BLOCK_SIZE x TRANSPOSE_BLOCK_SIZE are split over the threads */
+static void matrix_set_from_row_major_payload(mat *M, const char *payload, int dtype){
+    int ib, jb, i, j, imax, jmax, num_row_blocks, num_col_blocks;
+    size_t m, n;
+    const double *s64 = (const double*)payload;
+    const float *s32 = (const float*)payload;
+    m = M->nrows;
+    n = M->ncols;
+    num_row_blocks = (m + TRANSPOSE_BLOCK_SIZE - 1)/TRANSPOSE_BLOCK_SIZE;
+    num_col_blocks = (n + TRANSPOSE_BLOCK_SIZE - 1)/TRANSPOSE_BLOCK_SIZE;
+
+    #pragma omp parallel shared(M,s64,s32,dtype,m,n,num_row_blocks,num_col_blocks) private(ib,jb,i,j,imax,jmax) 
+    {
+    #pragma omp for collapse(2) schedule(static)
+    for(jb=0; jb<num_col_blocks; jb++){
+        for(ib=0; ib<num_row_blocks; ib++){
+            imax = min((ib+1)*TRANSPOSE_BLOCK_SIZE, m);
+            jmax = min((jb+1)*TRANSPOSE_BLOCK_SIZE, n);
+            if(dtype == MATRIX_FILE_DTYPE_FLOAT64){
+                for(j=jb*TRANSPOSE_BLOCK_SIZE; j<jmax; j++){
+                    for(i=ib*TRANSPOSE_BLOCK_SIZE; i<imax; i++){
+                        M->d[j*m + i] = s64[i*n + j];
+                    }
+                }
+            }
+            else{
+                for(j=jb*TRANSPOSE_BLOCK_SIZE; j<jmax; j++){
+                    for(i=ib*TRANSPOSE_BLOCK_SIZE; i<imax; i++){
+                        M->d[j*m + i] = s32[i*n + j];
+                    }
+                }
+            }
+        }
+    }
+    }
+}
+
+
 /* load matrix from binary file 
- * the nonzeros are in order of double loop over rows and columns
-format:
+ * legacy format has the nonzeros in order of double loop over rows and columns:
 num_rows (int) 
 num_columns (int)
 nnz (double)
 ...
 nnz (double)
+ * the self describing format has a matrix_file_header and a 64 byte aligned payload 
+ * in either storage order; the format is detected from the magic bytes.
+ * the file is memory mapped; a column major payload in the working precision 
+ * is used as M->d directly (copy on write) while a row major payload is reordered 
+ * straight from the page cache into the column major M->d; a payload in the 
+ * other precision is converted entry by entry on the way
 */
 mat * matrix_load_from_binary_file(char *fname){
-    int i, j, num_rows, num_columns, row_num, col_num;
+    int fd;
+    size_t file_size;
+    struct stat file_stat;
+    char *file_map;
+    double start_time, elapsed_time;
+    matrix_file_header header;
+    size_t j, m, n, dtype_size;
+    char *payload;
+    mat *M;
+
+    start_time = dsecnd();
+    fd = open(fname, O_RDONLY);
+    if(fd < 0){
+        printf("could not open %s\n", fname);
+        return NULL;
+    }
+    if(fstat(fd, &file_stat) != 0){
+        printf("could not stat %s\n", fname);
+        close(fd);
+        return NULL;
+    }
+    file_size = file_stat.st_size;
+    file_map = (char*)mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file_map == MAP_FAILED){
+        printf("could not map %s\n", fname);
+        return NULL;
+    }
+
+    if(matrix_file_header_from_bytes(file_map, file_size, &header) != 0 || 
+        (dtype_size = matrix_file_dtype_size(header.dtype)) == 0 || 
+        header.nrows > INT_MAX || header.ncols > INT_MAX ||
+        matrix_file_check_payload_size(&header, dtype_size, file_size) != 0){
+        printf("%s is not a supported binary matrix file\n", fname);
+        munmap(file_map, file_size);
+        return NULL;
+    }
+    printf("initializing M of size %d by %d (format version %d)\n", (int)header.nrows, (int)header.ncols, header.version);
+
+    if(header.storage_order == MATRIX_FILE_COL_MAJOR && header.dtype == MATRIX_FILE_DTYPE_NATIVE){
+        // payload is already laid out as M->d
+        madvise(file_map, file_size, MADV_WILLNEED);
+        M = malloc(sizeof(mat));
+        M->nrows = header.nrows;
+        M->ncols = header.ncols;
+        M->d = (real_t*)(file_map + header.data_offset);
+        M->mapping = file_map;
+        M->mapping_length = file_size;
+        M->sp = NULL;
+        M->spt = NULL;
+        elapsed_time = dsecnd() - start_time;
+        printf("mapped %.1f MB in %.3f seconds without copying\n", file_size/1.0e6, elapsed_time);
+        return M;
+    }
+
+    madvise(file_map, file_size, MADV_WILLNEED);
+    M = matrix_new(header.nrows,header.ncols);
+    printf("done..\n");
+
+    payload = file_map + header.data_offset;
+    if(header.storage_order == MATRIX_FILE_ROW_MAJOR){
+        // reorder the row major payload into M, converting tile by tile
+        matrix_set_from_row_major_payload(M, payload, header.dtype);
+    }
+    else{
+        // convert the contiguous columns of a column major payload
+        m = header.nrows; n = header.ncols;
+        #pragma omp parallel shared(M,payload,header,m,n,dtype_size) private(j) 
+        {
+        #pragma omp for schedule(static)
+        for(j=0; j<n; j++){
+            matrix_convert_payload(M->d + j*m, payload + j*m*dtype_size, m, header.dtype);
+        }
+        }
+    }
+    if(header.dtype != MATRIX_FILE_DTYPE_NATIVE){
+        printf("converted payload from %s precision\n", 
+            header.dtype == MATRIX_FILE_DTYPE_FLOAT32 ? "single" : "double");
+    }
+    munmap(file_map, file_size);
+
+    elapsed_time = dsecnd() - start_time;
+    printf("loaded %.1f MB in %.3f seconds (%.1f MB/s)\n", file_size/1.0e6, 
+        elapsed_time, file_size/1.0e6/elapsed_time);
+
+    return M;
+}
+
+
+/* load a sparse matrix in CSR from a MatrixMarket coordinate file */
+spmat * spmat_load_from_matrix_market_file(char *fname){
+    int i, num_rows, num_columns, row_num, col_num, base, pattern, symmetric;
+    int64_t t, e, num_nonzeros, num_entries;
     double nnz_val;
-    size_t one = 1;
+    char line[1024];
+    int *rows, *cols;
+    real_t *vals;
     FILE *fp;
-    mat *M;
-    
+    spmat *A;
+
     fp = fopen(fname,"r");
-    fread(&num_rows,sizeof(int),one,fp); //read m
-    fread(&num_columns,sizeof(int),one,fp); //read n
-    printf("initializing M of size %d by %d\n", num_rows, num_columns);
-    M = matrix_new(num_rows,num_columns);
-    printf("done..\n");
+    if(fp == NULL){
+        printf("could not open %s\n", fname);
+        return NULL;
+    }
+
+    // banner: MatrixMarket indices are 1-based, the old text format 0-based
+    fgets(line,sizeof(line),fp);
+    base = 0; pattern = 0; symmetric = 0;
+    if(strncmp(line, "%%MatrixMarket", 14) == 0){
+        base = 1;
+        if(strstr(line, "coordinate") == NULL){
+            printf("%s: only coordinate MatrixMarket files are supported\n", fname);
+            fclose(fp);
+            return NULL;
+        }
+        pattern = (strstr(line, "pattern") != NULL);
+        symmetric = (strstr(line, "symmetric") != NULL || strstr(line, "hermitian") != NULL);
+        // skip the remaining comment lines
+        do{
+            fgets(line,sizeof(line),fp);
+        } while(line[0] == '%');
+    }
+    else{
+        fgets(line,sizeof(line),fp); //read dimensions and nnzs 
+    }
+    sscanf(line, "%d %d %" SCNd64, &num_rows, &num_columns, &num_nonzeros);
+    printf("reading %d x %d sparse matrix with %" PRId64 " stored entries from %s\n", num_rows, num_columns, num_nonzeros, fname);
+
+    // stream the triples into coordinate arrays (symmetric files store one triangle)
+    num_entries = symmetric ? 2*num_nonzeros : num_nonzeros;
+    rows = (int*)malloc(num_entries*sizeof(int));
+    cols = (int*)malloc(num_entries*sizeof(int));
+    vals = (real_t*)malloc(num_entries*sizeof(real_t));
+    t = 0;
+    nnz_val = 1.0;
+    for(e=0; e<num_nonzeros; e++){
+        if(fgets(line,sizeof(line),fp) == NULL){
+            break;
+        }
+        if(pattern){
+            sscanf(line, "%d %d", &row_num, &col_num);
+        }
+        else{
+            sscanf(line, "%d %d %lf", &row_num, &col_num, &nnz_val);
+        }
+        rows[t] = row_num - base; cols[t] = col_num - base; vals[t] = nnz_val;
+        t++;
+        if(symmetric && row_num != col_num){
+            rows[t] = col_num - base; cols[t] = row_num - base; vals[t] = nnz_val;
+            t++;
+        }
+    }
+    fclose(fp);
+    num_entries = t;
 
-    // read and set elements
+    // coordinate to CSR by counting the entries of each row
+    A = spmat_new(num_rows, num_columns, num_entries);
+    for(t=0; t<num_entries; t++){
+        A->row_ptr[rows[t]+1]++;
+    }
     for(i=0; i<num_rows; i++){
-        for(j=0; j<num_columns; j++){
-            fread(&nnz_val,sizeof(double),one,fp); //read nnz
-            matrix_set_element(M,i,j,nnz_val);
+        A->row_ptr[i+1] += A->row_ptr[i];
+    }
+    int64_t *next = (int64_t*)malloc(num_rows*sizeof(int64_t));
+    memcpy(next, A->row_ptr, num_rows*sizeof(int64_t));
+    for(t=0; t<num_entries; t++){
+        A->col_ind[next[rows[t]]] = cols[t];
+        A->d[next[rows[t]]] = vals[t];
+        next[rows[t]]++;
+    }
+
+    free(next);
+    free(rows);
+    free(cols);
+    free(vals);
+
+    return A;
+}
+
+
+/* At = A^T in CSR by a counting sort over the columns of A */
+spmat * spmat_transpose(spmat *A){
+    int i,j;
+    int64_t t,r;
+    spmat *At = spmat_new(A->ncols, A->nrows, A->nnz);
+    for(t=0; t<A->nnz; t++){
+        At->row_ptr[A->col_ind[t]+1]++;
+    }
+    for(j=0; j<A->ncols; j++){
+        At->row_ptr[j+1] += At->row_ptr[j];
+    }
+    int64_t *next = (int64_t*)malloc(A->ncols*sizeof(int64_t));
+    memcpy(next, At->row_ptr, A->ncols*sizeof(int64_t));
+    for(i=0; i<A->nrows; i++){
+        for(t=A->row_ptr[i]; t<A->row_ptr[i+1]; t++){
+            r = next[A->col_ind[t]]++;
+            At->col_ind[r] = i;
+            At->d[r] = A->d[t];
+        }
+    }
+    free(next);
+    return At;
+}
+
+
+/* fill in header from the first bytes of a binary matrix file;
+ * files without the magic bytes are taken to be in the legacy format */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header){
+    int legacy_dims[2];
+    if(num_bytes >= MATRIX_FILE_HEADER_SIZE && 
+        memcmp(bytes, MATRIX_FILE_MAGIC, sizeof(header->magic)) == 0){
+        memcpy(header, bytes, sizeof(matrix_file_header));
+        // the payload is 64 byte aligned, so that it can be used in place
+        if(header->version > MATRIX_FILE_VERSION || header->data_offset < MATRIX_FILE_HEADER_SIZE || 
+            header->data_offset % 64 != 0){
+            return -1;
         }
+        return 0;
+    }
+
+    if(num_bytes < MATRIX_FILE_LEGACY_HEADER_SIZE){
+        return -1;
+    }
+    memcpy(legacy_dims, bytes, MATRIX_FILE_LEGACY_HEADER_SIZE);
+    memset(header, 0, sizeof(matrix_file_header));
+    memcpy(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic));
+    header->version = 0;
+    header->dtype = MATRIX_FILE_DTYPE_FLOAT64;
+    header->storage_order = MATRIX_FILE_ROW_MAJOR;
+    header->nrows = legacy_dims[0];
+    header->ncols = legacy_dims[1];
+    header->data_offset = MATRIX_FILE_LEGACY_HEADER_SIZE;
+    return (legacy_dims[0] < 0 || legacy_dims[1] < 0) ? -1 : 0;
+}
+
+
+/* read header of a binary matrix file from the current position of fp;
+ * on return fp is positioned at the start of the payload */
+int matrix_read_binary_file_header(FILE *fp, matrix_file_header *header){
+    char bytes[MATRIX_FILE_HEADER_SIZE];
+    size_t num_bytes;
+    num_bytes = fread(bytes, 1, MATRIX_FILE_LEGACY_HEADER_SIZE, fp);
+    if(num_bytes == MATRIX_FILE_LEGACY_HEADER_SIZE && 
+        memcmp(bytes, MATRIX_FILE_MAGIC, MATRIX_FILE_LEGACY_HEADER_SIZE) == 0){
+        num_bytes += fread(bytes + num_bytes, 1, MATRIX_FILE_HEADER_SIZE - num_bytes, fp);
+    }
+    if(matrix_file_header_from_bytes(bytes, num_bytes, header) != 0){
+        return -1;
+    }
+
+    // skip ahead to the payload by reading, not seeking
+    for(num_bytes = max(num_bytes, MATRIX_FILE_LEGACY_HEADER_SIZE); num_bytes < header->data_offset; num_bytes++){
+        if(fgetc(fp) == EOF){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* write header of the self describing format padded out to the payload offset */
+void matrix_write_binary_file_header(FILE *fp, int64_t nrows, int64_t ncols, int dtype, int storage_order){
+    matrix_file_header header;
+    memset(&header, 0, sizeof(matrix_file_header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.dtype = dtype;
+    header.storage_order = storage_order;
+    header.nrows = nrows;
+    header.ncols = ncols;
+    header.data_offset = MATRIX_FILE_HEADER_SIZE;
+    fwrite(&header, sizeof(matrix_file_header), 1, fp);
+}
+
+
+/* write M to binary file in the self describing format */
+void matrix_write_to_binary_file(mat *M, char *fname, int storage_order){
+    int i, i0, num_block_rows;
+    size_t m, n;
+    real_t *row_block;
+    FILE *fp;
+
+    m = M->nrows; n = M->ncols;
+    fp = fopen(fname,"w");
+    matrix_write_binary_file_header(fp, m, n, MATRIX_FILE_DTYPE_NATIVE, storage_order);
+    if(storage_order == MATRIX_FILE_COL_MAJOR){
+        fwrite(M->d, sizeof(real_t), m*n, fp);
+    }
+    else{
+        // write blocks of rows transposed into row major order
+        row_block = (real_t*)malloc(TRANSPOSE_BLOCK_SIZE*n*sizeof(real_t));
+        for(i0=0; i0<m; i0+=TRANSPOSE_BLOCK_SIZE){
+            num_block_rows = min(TRANSPOSE_BLOCK_SIZE, m - i0);
+            for(i=0; i<num_block_rows; i++){
+                cblas_rcopy(n, M->d + i0 + i, m, row_block + i*n, 1);
+            }
+            fwrite(row_block, sizeof(real_t), num_block_rows*n, fp);
+        }
+        free(row_block);
     }
     fclose(fp);
+}
 
-    return M;
+
+/* convert legacy binary matrix file to the self describing format; 
+ * the legacy file is memory mapped and written out in blocks so the 
+ * whole matrix is never held in memory */
+int matrix_convert_legacy_binary_file(char *legacy_fname, char *fname, int storage_order){
+    int fd, i, j, j0, num_block_cols;
+    size_t m, n, file_size;
+    struct stat file_stat;
+    char *file_map;
+    double *payload, *col_block;
+    matrix_file_header header;
+    FILE *fp;
+
+    fd = open(legacy_fname, O_RDONLY);
+    if(fd < 0){
+        printf("could not open %s\n", legacy_fname);
+        return -1;
+    }
+    if(fstat(fd, &file_stat) != 0){
+        printf("could not stat %s\n", legacy_fname);
+        close(fd);
+        return -1;
+    }
+    file_size = file_stat.st_size;
+    file_map = (char*)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file_map == MAP_FAILED || matrix_file_header_from_bytes(file_map, file_size, &header) != 0 || 
+        header.version != 0 || matrix_file_check_payload_size(&header, sizeof(double), file_size) != 0){
+        printf("%s is not a legacy binary matrix file\n", legacy_fname);
+        if(file_map != MAP_FAILED) munmap(file_map, file_size);
+        return -1;
+    }
+    madvise(file_map, file_size, MADV_SEQUENTIAL);
+    m = header.nrows; n = header.ncols;
+    payload = (double*)(file_map + header.data_offset);
+    printf("converting %s (%ld by %ld) to %s\n", legacy_fname, (long)m, (long)n, fname);
+
+    fp = fopen(fname,"w");
+    matrix_write_binary_file_header(fp, m, n, MATRIX_FILE_DTYPE_FLOAT64, storage_order);
+    if(storage_order == MATRIX_FILE_ROW_MAJOR){
+        fwrite(payload, sizeof(double), m*n, fp);
+    }
+    else{
+        // gather blocks of columns from the row major payload
+        col_block = (double*)malloc(m*TRANSPOSE_BLOCK_SIZE*sizeof(double));
+        for(j0=0; j0<n; j0+=TRANSPOSE_BLOCK_SIZE){
+            num_block_cols = min(TRANSPOSE_BLOCK_SIZE, n - j0);
+            #pragma omp parallel shared(col_block,payload,m,n,j0,num_block_cols) private(i,j) 
+            {
+            #pragma omp for
+            for(i=0; i<m; i++){
+                for(j=0; j<num_block_cols; j++){
+                    col_block[j*m + i] = payload[i*n + j0 + j];
+                }
+            }
+            }
+            fwrite(col_block, sizeof(double), m*num_block_cols, fp);
+        }
+        free(col_block);
+    }
+    fclose(fp);
+    munmap(file_map, file_size);
+    return 0;
+}
+
+
+/* open binary matrix file for streaming in panels */
+matrix_file_stream * matrix_file_stream_open(char *fname, int panel_size){
+    size_t panel_length;
+    matrix_file_stream *S = malloc(sizeof(matrix_file_stream));
+
+    S->fp = (strcmp(fname,"-") == 0) ? stdin : fopen(fname,"r");
+    if(S->fp == NULL){
+        printf("could not open %s\n", fname);
+        free(S);
+        return NULL;
+    }
+    if(matrix_read_binary_file_header(S->fp, &(S->header)) != 0 || 
+        matrix_file_dtype_size(S->header.dtype) == 0 || 
+        S->header.nrows <= 0 || S->header.ncols <= 0 || 
+        S->header.nrows > INT_MAX || S->header.ncols > INT_MAX){
+        printf("%s is not a supported binary matrix file\n", fname);
+        fclose(S->fp);
+        free(S);
+        return NULL;
+    }
+    posix_fadvise(fileno(S->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+    S->position = 0;
+
+    // a panel holds panel_size full rows or full columns
+    if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+        S->panel_size = min(panel_size, S->header.nrows);
+        panel_length = ((size_t)S->panel_size)*S->header.ncols;
+    }
+    else{
+        S->panel_size = min(panel_size, S->header.ncols);
+        panel_length = ((size_t)S->panel_size)*S->header.nrows;
+    }
+    S->buffer = matrix_data_alloc(panel_length);
+    // panels in the other precision are read as is and converted into buffer
+    S->raw = NULL;
+    if(S->header.dtype != MATRIX_FILE_DTYPE_NATIVE){
+        S->raw = malloc(panel_length*matrix_file_dtype_size(S->header.dtype));
+    }
+    printf("streaming %s of size %d by %d in %s panels of %d\n", fname, (int)S->header.nrows, (int)S->header.ncols,
+        S->header.storage_order == MATRIX_FILE_ROW_MAJOR ? "row" : "column", S->panel_size);
+    return S;
+}
+
+
+void matrix_file_stream_close(matrix_file_stream *S){
+    if(S->fp != stdin){
+        fclose(S->fp);
+    }
+    matrix_data_free(S->buffer);
+    free(S->raw);
+    free(S);
+}
+
+
+/* move the stream back to the first panel */
+void matrix_file_stream_rewind(matrix_file_stream *S){
+    fseeko(S->fp, S->header.data_offset, SEEK_SET);
+    S->position = 0;
+}
+
+
+/* read the next panel of the stream into P */
+int matrix_file_stream_next_panel(matrix_file_stream *S, mat *P, int *offset){
+    int num_panel, remaining;
+    size_t panel_length, num_read;
+    int row_major = (S->header.storage_order == MATRIX_FILE_ROW_MAJOR);
+    int64_t num_panels_total = row_major ? S->header.nrows : S->header.ncols;
+    int64_t panel_depth = row_major ? S->header.ncols : S->header.nrows;
+
+    *offset = S->position;
+    remaining = num_panels_total - *offset;
+    if(remaining <= 0){
+        return 0;
+    }
+    num_panel = min(S->panel_size, remaining);
+    panel_length = ((size_t)num_panel)*panel_depth;
+    if(S->raw == NULL){
+        num_read = fread(S->buffer, sizeof(real_t), panel_length, S->fp);
+    }
+    else{
+        num_read = fread(S->raw, matrix_file_dtype_size(S->header.dtype), panel_length, S->fp);
+    }
+    if(num_read != panel_length){
+        printf("short read of panel at %d\n", *offset);
+        return 0;
+    }
+    if(S->raw != NULL){
+        matrix_convert_payload(S->buffer, (char*)S->raw, panel_length, S->header.dtype);
+    }
+    S->position += num_panel;
+
+    P->nrows = panel_depth;
+    P->ncols = num_panel;
+    P->d = S->buffer;
+    P->mapping = NULL;
+    P->mapping_length = 0;
+    P->sp = NULL;
+    P->spt = NULL;
+    return 1;
+}
+
+
+/* Y = M*X in one sequential pass over the file */
+void matrix_file_stream_mult(matrix_file_stream *S, mat *X, mat *Y){
+    int offset;
+    mat P;
+    matrix_file_stream_rewind(S);
+    if(S->header.storage_order == MATRIX_FILE_COL_MAJOR){
+        memset(Y->d, 0, ((size_t)Y->nrows)*(Y->ncols)*sizeof(real_t));
+    }
+    while(matrix_file_stream_next_panel(S, &P, &offset)){
+        if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+            // rows of Y are M(rows,:)*X = P^T*X
+            matrix_transpose_matrix_mult_into_rows(&P, X, Y, offset);
+        }
+        else{
+            // Y += M(:,cols)*X(cols,:)
+            matrix_matrix_mult_from_rows_add(&P, X, offset, Y);
+        }
+    }
+}
+
+
+/* Y = M*X and W = M^T*Z together in one sequential pass over the 
+ * remaining panels of the stream, without seeking */
+void matrix_file_stream_two_sided_mult(matrix_file_stream *S, mat *X, mat *Y, mat *Z, mat *W){
+    int offset;
+    mat P;
+    if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+        memset(W->d, 0, ((size_t)W->nrows)*(W->ncols)*sizeof(real_t));
+    }
+    else{
+        memset(Y->d, 0, ((size_t)Y->nrows)*(Y->ncols)*sizeof(real_t));
+    }
+    while(matrix_file_stream_next_panel(S, &P, &offset)){
+        if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+            matrix_transpose_matrix_mult_into_rows(&P, X, Y, offset);
+            matrix_matrix_mult_from_rows_add(&P, Z, offset, W);
+        }
+        else{
+            matrix_matrix_mult_from_rows_add(&P, X, offset, Y);
+            matrix_transpose_matrix_mult_into_rows(&P, Z, W, offset);
+        }
+    }
+}
+
+
+/* Y = M^T*X in one sequential pass over the file */
+void matrix_file_stream_transpose_mult(matrix_file_stream *S, mat *X, mat *Y){
+    int offset;
+    mat P;
+    matrix_file_stream_rewind(S);
+    if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+        memset(Y->d, 0, ((size_t)Y->nrows)*(Y->ncols)*sizeof(real_t));
+    }
+    while(matrix_file_stream_next_panel(S, &P, &offset)){
+        if(S->header.storage_order == MATRIX_FILE_ROW_MAJOR){
+            // Y += M(rows,:)^T*X(rows,:) = P*X(rows,:)
+            matrix_matrix_mult_from_rows_add(&P, X, offset, Y);
+        }
+        else{
+            // rows of Y are M(:,cols)^T*X = P^T*X
+            matrix_transpose_matrix_mult_into_rows(&P, X, Y, offset);
+        }
+    }
 }
 
 
+/* fill column major M from row major data with a cache blocked transpose;
+ * tiles of TRANSPOSE_BLOCK_SIZE x TRANSPOSE_BLOCK_SIZE are split over the threads */
+void matrix_set_from_row_major_data(mat *M, real_t *data){
+    matrix_set_from_row_major_payload(M, (const char*)data, MATRIX_FILE_DTYPE_NATIVE);
+}
+
 
-void vector_set_data(vec *v, double *data){
+
+void vector_set_data(vec *v, real_t *data){
     int i;
     #pragma omp parallel shared(v) private(i) 
     {
@@ -128,11 +981,11 @@ void vector_scale(vec *v, double scalar){
 
 /* scale matrix by a constant */
 void matrix_scale(mat *M, double scalar){
-    int i;
+    int64_t i;
     #pragma omp parallel shared(M,scalar) private(i) 
     {
     #pragma omp for
-    for(i=0; i<((M->nrows)*(M->ncols)); i++){
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
         M->d[i] = scalar*(M->d[i]);
     }
     }
@@ -173,12 +1026,12 @@ void vector_copy(vec *d, vec *s){
 
 /* copy contents of mat S to D  */
 void matrix_copy(mat *D, mat *S){
-    int i;
+    int64_t i;
     //#pragma omp parallel for
     #pragma omp parallel shared(D,S) private(i) 
     {
     #pragma omp for 
-    for(i=0; i<((S->nrows)*(S->ncols)); i++){
+    for(i=0; i<((int64_t)(S->nrows))*(S->ncols); i++){
         D->d[i] = S->d[i];
     }
     }
@@ -188,11 +1041,11 @@ void matrix_copy(mat *D, mat *S){
 
 /* hard threshold matrix entries  */
 void matrix_hard_threshold(mat *M, double TOL){
-    int i;
+    int64_t i;
     #pragma omp parallel shared(M) private(i) 
     {
     #pragma omp for 
-    for(i=0; i<((M->nrows)*(M->ncols)); i++){
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
         if(fabs(M->d[i]) < TOL){
             M->d[i] = 0;
         }
@@ -231,26 +1084,45 @@ void vector_sub(vec *a, vec *b){
 
 /* subtract B from A and save result in A  */
 void matrix_sub(mat *A, mat *B){
-    int i;
+    int64_t i;
     //#pragma omp parallel for
     #pragma omp parallel shared(A,B) private(i) 
     {
     #pragma omp for 
-    for(i=0; i<((A->nrows)*(A->ncols)); i++){
+    for(i=0; i<((int64_t)(A->nrows))*(A->ncols); i++){
         A->d[i] = A->d[i] - B->d[i];
     }
     }
 }
 
 
+/* add B to A and save result in A  */
+void matrix_add(mat *A, mat *B){
+    int64_t i;
+    #pragma omp parallel shared(A,B) private(i) 
+    {
+    #pragma omp for 
+    for(i=0; i<((int64_t)(A->nrows))*(A->ncols); i++){
+        A->d[i] = A->d[i] + B->d[i];
+    }
+    }
+}
+
+
 /* matrix frobenius norm */
 double get_matrix_frobenius_norm(mat *M){
-    int i;
+    int64_t i;
     double val, normval = 0;
+    if(M->sp != NULL){
+        for(i=0; i<M->sp->nnz; i++){
+            normval += M->sp->d[i]*M->sp->d[i];
+        }
+        return sqrt(normval);
+    }
     #pragma omp parallel shared(M,normval) private(i,val) 
     {
     #pragma omp for reduction(+:normval)
-    for(i=0; i<((M->nrows)*(M->ncols)); i++){
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
         val = M->d[i];
         normval += val*val;
     }
@@ -261,9 +1133,9 @@ double get_matrix_frobenius_norm(mat *M){
 
 /* matrix max abs val */
 double get_matrix_max_abs_element(mat *M){
-    int i;
+    int64_t i;
     double val, max = 0;
-    for(i=0; i<((M->nrows)*(M->ncols)); i++){
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
         val = M->d[i];
         if( fabs(val) > max )
             max = val;
@@ -272,78 +1144,588 @@ double get_matrix_max_abs_element(mat *M){
 }
 
 
+/* random stream shared by all generators, created on first use so that 
+ * matrices drawn within the same second are still independent */
+static VSLStreamStatePtr random_stream = NULL;
+
+static VSLStreamStatePtr get_random_stream(){
+    if(random_stream == NULL){
+        vslNewStream( &random_stream, BRNG,  time(NULL) );
+        //vslNewStream( &random_stream, BRNG,  SEED );
+    }
+    return random_stream;
+}
+
+
 /* initialize a random matrix */
 void initialize_random_matrix(mat *M){
-    int i,m,n;
-    double val;
-    m = M->nrows;
-    n = M->ncols;
-    float a=0.0,sigma=1.0;
-    int N = m*n;
-    float *r;
-    VSLStreamStatePtr stream;
-    
-    r = (float*)malloc(N*sizeof(float));
-   
-    vslNewStream( &stream, BRNG,  time(NULL) );
-    //vslNewStream( &stream, BRNG,  SEED );
+    int64_t i,N;
+    int num;
+    real_t a=0.0,sigma=1.0;
+    N = ((int64_t)(M->nrows))*(M->ncols);
+    VSLStreamStatePtr stream = get_random_stream();
+
+    // generate straight into M, no intermediate buffer; the 
+    // VSL count is an int, so large matrices go in chunks
+    for(i=0; i<N; i+=num){
+        num = (int)min(N - i, (int64_t)RANDOM_CHUNK_SIZE);
+        vrRngGaussian( METHOD, stream, num, M->d + i, a, sigma );
+    }
+}
+
+
+
+/* Y = M*Omega for the random test matrix Omega of the given sketch_type */
+void matrix_random_sketch_mult(mat *M, mat *Y, int sketch_type){
+    if(M->sp != NULL && sketch_type != SKETCH_GAUSSIAN){
+        // the structured sketches need a dense M; M*RN is O(nnz*l) anyway
+        printf("sparse M: using a Gaussian sketch\n");
+        sketch_type = SKETCH_GAUSSIAN;
+    }
+    if(sketch_type == SKETCH_SRHT){
+        matrix_srht_sketch_mult(M, Y);
+    }
+    else if(sketch_type == SKETCH_SPARSE_SIGN){
+        int zeta = min(SPARSE_SIGN_NNZ_PER_ROW, Y->ncols);
+        spmat *RN = spmat_new(M->ncols, Y->ncols, ((int64_t)M->ncols)*zeta);
+        initialize_sparse_sign_matrix(RN, zeta);
+        matrix_sparse_matrix_mult(M, RN, Y);
+        spmat_delete(RN);
+    }
+    else{
+        mat *RN = matrix_new(M->ncols, Y->ncols);
+        initialize_random_matrix(RN);
+        matrix_matrix_mult(M, RN, Y);
+        matrix_delete(RN);
+    }
+}
 
-    vsRngGaussian( METHOD, stream, N, r, a, sigma );
 
-    // read and set elements
-    #pragma omp parallel shared(M,N,r) private(i,val) 
+mat_float * matrix_float_new(int nrows, int ncols){
+    mat_float *F = malloc(sizeof(mat_float));
+    F->d = (float*)matrix_bytes_alloc(((size_t)nrows)*ncols*sizeof(float));
+    F->nrows = nrows; F->ncols = ncols;
+    return F;
+}
+
+
+void matrix_float_delete(mat_float *F){
+    matrix_data_free(F->d);
+    free(F);
+}
+
+
+void matrix_float_from_double(mat_float *F, mat *M){
+    int64_t i;
+    #pragma omp parallel shared(F,M) private(i) 
     {
-    #pragma omp parallel for
-    for(i=0; i<N; i++){
-        val = r[i];
-        M->d[i] = val;
+    #pragma omp for 
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
+        F->d[i] = (float)M->d[i];
     }
     }
-    
-    free(r);
 }
 
 
-/* C = A*B ; column major */
+void matrix_double_from_float(mat *M, mat_float *F){
+    int64_t i;
+    #pragma omp parallel shared(F,M) private(i) 
+    {
+    #pragma omp for 
+    for(i=0; i<((int64_t)(M->nrows))*(M->ncols); i++){
+        M->d[i] = F->d[i];
+    }
+    }
+}
+
+
+void initialize_random_matrix_float(mat_float *F){
+    int64_t i,N;
+    int num;
+    N = ((int64_t)(F->nrows))*(F->ncols);
+    VSLStreamStatePtr stream = get_random_stream();
+    for(i=0; i<N; i+=num){
+        num = (int)min(N - i, (int64_t)RANDOM_CHUNK_SIZE);
+        vsRngGaussian( METHOD, stream, num, F->d + i, 0.0f, 1.0f );
+    }
+}
+
+
+void matrix_float_matrix_mult(mat_float *A, mat_float *B, mat_float *C){
+    cblas_sgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, C->ncols, A->ncols, 1.0f, A->d, A->nrows, B->d, B->nrows, 0.0f, C->d, C->nrows);
+}
+
+
+void matrix_float_transpose_matrix_mult(mat_float *A, mat_float *B, mat_float *C){
+    cblas_sgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, C->ncols, A->nrows, 1.0f, A->d, A->nrows, B->d, B->nrows, 0.0f, C->d, C->nrows);
+}
+
+
+mat_quantized * matrix_quantized_new_from_matrix(mat *M, int bits){
+    int64_t j;
+    int i, b, i0, nr, m, n;
+    double maxval, scale, inv_scale, qmax;
+    real_t *x;
+    int8_t *q8;
+    int16_t *q16;
+    mat_quantized *Mq = malloc(sizeof(mat_quantized));
+
+    m = M->nrows; n = M->ncols;
+    Mq->nrows = m; Mq->ncols = n;
+    Mq->bits = (bits == 8) ? 8 : 16;
+    Mq->num_row_blocks = (m + QUANTIZE_BLOCK_ROWS - 1)/QUANTIZE_BLOCK_ROWS;
+    Mq->q = matrix_bytes_alloc(((size_t)m)*n*(Mq->bits/8));
+    Mq->scales = (float*)matrix_bytes_alloc(((size_t)n)*Mq->num_row_blocks*sizeof(float));
+    qmax = (Mq->bits == 8) ? 127.0 : 32767.0;
+    q8 = (int8_t*)Mq->q;
+    q16 = (int16_t*)Mq->q;
+
+    #pragma omp parallel shared(M,Mq,m,n,qmax,q8,q16) private(i,j,b,i0,nr,x,maxval,scale,inv_scale) 
+    {
+    #pragma omp for 
+    for(j=0; j<n; j++){
+        for(b=0; b<Mq->num_row_blocks; b++){
+            i0 = b*QUANTIZE_BLOCK_ROWS;
+            nr = min(QUANTIZE_BLOCK_ROWS, m - i0);
+            x = M->d + j*m + i0;
+            maxval = 0.0;
+            for(i=0; i<nr; i++){
+                maxval = max(maxval, fabs(x[i]));
+            }
+            scale = maxval/qmax;
+            inv_scale = (maxval > 0) ? 1.0/scale : 0.0;
+            Mq->scales[j*Mq->num_row_blocks + b] = scale;
+            if(Mq->bits == 8){
+                for(i=0; i<nr; i++){
+                    q8[j*m + i0 + i] = (int8_t)lrint(x[i]*inv_scale);
+                }
+            }
+            else{
+                for(i=0; i<nr; i++){
+                    q16[j*m + i0 + i] = (int16_t)lrint(x[i]*inv_scale);
+                }
+            }
+        }
+    }
+    }
+    return Mq;
+}
+
+
+void matrix_quantized_delete(mat_quantized *Mq){
+    matrix_data_free(Mq->q);
+    matrix_data_free(Mq->scales);
+    free(Mq);
+}
+
+
+size_t matrix_quantized_bytes(mat_quantized *Mq){
+    return ((size_t)Mq->nrows)*Mq->ncols*(Mq->bits/8) + ((size_t)Mq->ncols)*Mq->num_row_blocks*sizeof(float);
+}
+
+
+/* tile = Mq(i0:i0+nr-1, j0:j0+nc-1) in the working precision, column major with 
+ * leading dimension nr; i0 is a multiple of QUANTIZE_BLOCK_ROWS */
+static void matrix_quantized_get_tile(mat_quantized *Mq, int i0, int j0, int nr, int nc, real_t *tile){
+    int i, j, b, r0, br;
+    size_t m = Mq->nrows;
+    real_t scale, *t;
+    float *scales;
+
+    for(j=0; j<nc; j++){
+        scales = Mq->scales + ((size_t)(j0+j))*Mq->num_row_blocks;
+        t = tile + ((size_t)j)*nr;
+        for(r0=0; r0<nr; r0+=QUANTIZE_BLOCK_ROWS){
+            b = (i0 + r0)/QUANTIZE_BLOCK_ROWS;
+            br = min(QUANTIZE_BLOCK_ROWS, nr - r0);
+            scale = scales[b];
+            if(Mq->bits == 8){
+                int8_t *q = (int8_t*)Mq->q + (j0+j)*m + i0 + r0;
+                #pragma omp simd
+                for(i=0; i<br; i++){
+                    t[r0+i] = scale*q[i];
+                }
+            }
+            else{
+                int16_t *q = (int16_t*)Mq->q + (j0+j)*m + i0 + r0;
+                #pragma omp simd
+                for(i=0; i<br; i++){
+                    t[r0+i] = scale*q[i];
+                }
+            }
+        }
+    }
+}
+
+
+double matrix_quantized_relative_error(mat_quantized *Mq, mat *M){
+    int i0, j0, nr, nc, i, j, m, n;
+    double diffval = 0, normval = 0, d;
+    real_t *tile, *x;
+    m = M->nrows; n = M->ncols;
+
+    #pragma omp parallel shared(M,Mq,m,n) private(i0,j0,nr,nc,i,j,d,tile,x) 
+    {
+    tile = (real_t*)malloc(((size_t)QUANTIZE_TILE_ROWS)*QUANTIZE_TILE_COLS*sizeof(real_t));
+    #pragma omp for reduction(+:diffval,normval)
+    for(j0=0; j0<n; j0+=QUANTIZE_TILE_COLS){
+        nc = min(QUANTIZE_TILE_COLS, n - j0);
+        for(i0=0; i0<m; i0+=QUANTIZE_TILE_ROWS){
+            nr = min(QUANTIZE_TILE_ROWS, m - i0);
+            matrix_quantized_get_tile(Mq, i0, j0, nr, nc, tile);
+            for(j=0; j<nc; j++){
+                x = M->d + ((size_t)(j0+j))*m + i0;
+                for(i=0; i<nr; i++){
+                    d = x[i] - tile[((size_t)j)*nr + i];
+                    diffval += d*d;
+                    normval += ((double)x[i])*x[i];
+                }
+            }
+        }
+    }
+    free(tile);
+    }
+
+    return sqrt(diffval/normval);
+}
+
+
+void matrix_quantized_matrix_mult(mat_quantized *Mq, mat *X, mat *Y){
+    int i0, j0, nr, nc, m, n, l;
+    real_t *tile;
+    m = Mq->nrows; n = Mq->ncols; l = Y->ncols;
+
+    // row blocks of Y are independent, each sums over the column tiles of Mq
+    #pragma omp parallel shared(Mq,X,Y,m,n,l) private(i0,j0,nr,nc,tile) 
+    {
+    tile = (real_t*)malloc(((size_t)QUANTIZE_TILE_ROWS)*QUANTIZE_TILE_COLS*sizeof(real_t));
+    #pragma omp for schedule(dynamic)
+    for(i0=0; i0<m; i0+=QUANTIZE_TILE_ROWS){
+        nr = min(QUANTIZE_TILE_ROWS, m - i0);
+        for(j0=0; j0<n; j0+=QUANTIZE_TILE_COLS){
+            nc = min(QUANTIZE_TILE_COLS, n - j0);
+            matrix_quantized_get_tile(Mq, i0, j0, nr, nc, tile);
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, nr, l, nc, 1.0, tile, nr, 
+                X->d + j0, X->nrows, (j0 == 0) ? 0.0 : 1.0, Y->d + i0, Y->nrows);
+        }
+    }
+    free(tile);
+    }
+}
+
+
+void matrix_quantized_transpose_matrix_mult(mat_quantized *Mq, mat *X, mat *Y){
+    int i0, j0, nr, nc, m, n, l;
+    real_t *tile;
+    m = Mq->nrows; n = Mq->ncols; l = Y->ncols;
+
+    // row blocks of Y are the column tiles of Mq, each sums over the row tiles
+    #pragma omp parallel shared(Mq,X,Y,m,n,l) private(i0,j0,nr,nc,tile) 
+    {
+    tile = (real_t*)malloc(((size_t)QUANTIZE_TILE_ROWS)*QUANTIZE_TILE_COLS*sizeof(real_t));
+    #pragma omp for schedule(dynamic)
+    for(j0=0; j0<n; j0+=QUANTIZE_TILE_COLS){
+        nc = min(QUANTIZE_TILE_COLS, n - j0);
+        for(i0=0; i0<m; i0+=QUANTIZE_TILE_ROWS){
+            nr = min(QUANTIZE_TILE_ROWS, m - i0);
+            matrix_quantized_get_tile(Mq, i0, j0, nr, nc, tile);
+            cblas_rgemm(CblasColMajor, CblasTrans, CblasNoTrans, nc, l, nr, 1.0, tile, nr, 
+                X->d + i0, X->nrows, (i0 == 0) ? 0.0 : 1.0, Y->d + j0, Y->nrows);
+        }
+    }
+    free(tile);
+    }
+}
+
+
+/* Y = M*Omega with Omega = sqrt(N/l) D H P the subsampled randomized Hadamard transform */
+void matrix_srht_sketch_mult(mat *M, mat *Y){
+    int i,j,c,h,m,n,l,N,r0,nr;
+    int *signs, *cols;
+    real_t a,b,*buf,*x,*y;
+    double scale;
+    VSLStreamStatePtr stream = get_random_stream();
+    m = M->nrows; n = M->ncols; l = Y->ncols;
+    N = 1;
+    while(N < n){
+        N *= 2;
+    }
+
+    // random signs D and l distinct columns P out of N (partial Fisher-Yates)
+    signs = (int*)malloc(n*sizeof(int));
+    cols = (int*)malloc(N*sizeof(int));
+    double *u = (double*)malloc(l*sizeof(double));
+    viRngUniform( VSL_RNG_METHOD_UNIFORM_STD, stream, n, signs, 0, 2 );
+    vdRngUniform( VSL_RNG_METHOD_UNIFORM_STD, stream, l, u, 0.0, 1.0 );
+    for(j=0; j<N; j++){
+        cols[j] = j;
+    }
+    for(c=0; c<l; c++){
+        j = c + (int)(u[c]*(N-c));
+        if(j >= N) j = N-1;
+        i = cols[c]; cols[c] = cols[j]; cols[j] = i;
+    }
+    free(u);
+
+    // entries of the unnormalized transform are +-1, so sqrt(N/l)/sqrt(N)
+    scale = 1.0/sqrt((double)l);
+
+    #pragma omp parallel shared(M,Y,signs,cols,m,n,l,N,scale) private(i,j,c,h,r0,nr,a,b,buf,x,y) 
+    {
+    // each thread transforms its own block of rows, stored column major 
+    // with leading dimension SRHT_BLOCK_ROWS so that every butterfly 
+    // combines two contiguous vectors
+    buf = (real_t*)malloc(((size_t)N)*SRHT_BLOCK_ROWS*sizeof(real_t));
+
+    #pragma omp for schedule(dynamic)
+    for(r0=0; r0<m; r0+=SRHT_BLOCK_ROWS){
+        nr = min(SRHT_BLOCK_ROWS, m - r0);
+
+        // load D*M(r0:r0+nr-1,:) and zero pad to N columns
+        for(j=0; j<n; j++){
+            x = buf + ((size_t)j)*SRHT_BLOCK_ROWS;
+            y = M->d + ((size_t)j)*m + r0;
+            a = signs[j] ? 1.0 : -1.0;
+            for(i=0; i<nr; i++){
+                x[i] = a*y[i];
+            }
+        }
+        memset(buf + ((size_t)n)*SRHT_BLOCK_ROWS, 0, ((size_t)(N-n))*SRHT_BLOCK_ROWS*sizeof(real_t));
+
+        // fast Walsh-Hadamard transform along the rows
+        for(h=1; h<N; h*=2){
+            for(c=0; c<N; c+=2*h){
+                for(j=c; j<c+h; j++){
+                    x = buf + ((size_t)j)*SRHT_BLOCK_ROWS;
+                    y = buf + ((size_t)(j+h))*SRHT_BLOCK_ROWS;
+                    #pragma omp simd private(a,b)
+                    for(i=0; i<nr; i++){
+                        a = x[i]; b = y[i];
+                        x[i] = a + b;
+                        y[i] = a - b;
+                    }
+                }
+            }
+        }
+
+        // keep the sampled columns
+        for(c=0; c<l; c++){
+            x = buf + ((size_t)cols[c])*SRHT_BLOCK_ROWS;
+            y = Y->d + ((size_t)c)*m + r0;
+            for(i=0; i<nr; i++){
+                y[i] = scale*x[i];
+            }
+        }
+    }
+
+    free(buf);
+    }
+
+    free(signs);
+    free(cols);
+}
+
+
+/* fill RN with a sparse sign test matrix with zeta nonzeros per row */
+void initialize_sparse_sign_matrix(spmat *RN, int zeta){
+    int i,c,n,l,dup;
+    int64_t j,t;
+    int *cols, *signs;
+    real_t val;
+    VSLStreamStatePtr stream = get_random_stream();
+    n = RN->nrows; l = RN->ncols;
+    val = 1.0/sqrt((double)zeta);
+
+    cols = (int*)malloc(zeta*sizeof(int));
+    signs = (int*)malloc(zeta*sizeof(int));
+
+    for(i=0; i<n; i++){
+        RN->row_ptr[i] = ((int64_t)i)*zeta;
+        viRngUniform( VSL_RNG_METHOD_UNIFORM_STD, stream, zeta, cols, 0, l );
+        viRngUniform( VSL_RNG_METHOD_UNIFORM_STD, stream, zeta, signs, 0, 2 );
+        for(t=RN->row_ptr[i]; t<RN->row_ptr[i]+zeta; t++){
+            // columns within a row must be distinct, redraw collisions
+            c = cols[t - RN->row_ptr[i]];
+            do{
+                dup = 0;
+                for(j=RN->row_ptr[i]; j<t; j++){
+                    if(RN->col_ind[j] == c){
+                        dup = 1;
+                        viRngUniform( VSL_RNG_METHOD_UNIFORM_STD, stream, 1, &c, 0, l );
+                        break;
+                    }
+                }
+            } while(dup);
+            RN->col_ind[t] = c;
+            RN->d[t] = signs[t - RN->row_ptr[i]] ? val : -val;
+        }
+    }
+    RN->row_ptr[n] = ((int64_t)n)*zeta;
+
+    free(cols);
+    free(signs);
+}
+
+
+
+/* Y = A*X for sparse A in CSR and dense X */
+void spmat_matrix_mult(spmat *A, mat *X, mat *Y){
+    int i,c,m,l;
+    int64_t t;
+    real_t a,*xr,*yr;
+    mat Xl;
+    m = A->nrows; l = Y->ncols;
+
+    // X^T and Y^T in column major are X and Y in row major
+    matrix_columns_view(&Xl, X, 0, l);
+    mat *Xr = matrix_new(l, X->nrows);
+    matrix_set_from_row_major_data(Xr, Xl.d);
+    real_t *Yr = (real_t*)malloc(((size_t)m)*l*sizeof(real_t));
+
+    #pragma omp parallel shared(A,Xr,Yr,m,l) private(i,c,t,a,xr,yr) 
+    {
+    #pragma omp for schedule(dynamic,64)
+    for(i=0; i<m; i++){
+        yr = Yr + ((size_t)i)*l;
+        memset(yr, 0, l*sizeof(real_t));
+        for(t=A->row_ptr[i]; t<A->row_ptr[i+1]; t++){
+            a = A->d[t];
+            xr = Xr->d + ((size_t)A->col_ind[t])*l;
+            #pragma omp simd
+            for(c=0; c<l; c++){
+                yr[c] += a*xr[c];
+            }
+        }
+    }
+    }
+
+    matrix_set_from_row_major_data(Y, Yr);
+    matrix_delete(Xr);
+    free(Yr);
+}
+
+
+/* C = M*A for dense M and sparse A in CSR */
+void matrix_sparse_matrix_mult(mat *M, spmat *A, mat *C){
+    int i,j,m,n,l,r0,nr;
+    int64_t t;
+    real_t a,*x,*y;
+    m = M->nrows; n = M->ncols; l = C->ncols;
+
+    #pragma omp parallel shared(M,A,C,m,n,l) private(i,j,t,r0,nr,a,x,y) 
+    {
+    #pragma omp for schedule(dynamic)
+    for(r0=0; r0<m; r0+=SPARSE_MULT_BLOCK_ROWS){
+        nr = min(SPARSE_MULT_BLOCK_ROWS, m - r0);
+        for(j=0; j<l; j++){
+            memset(C->d + ((size_t)j)*m + r0, 0, nr*sizeof(real_t));
+        }
+        // C(block,:) += M(block,j)*A(j,:) for each nonzero of row j of A
+        for(j=0; j<n; j++){
+            x = M->d + ((size_t)j)*m + r0;
+            for(t=A->row_ptr[j]; t<A->row_ptr[j+1]; t++){
+                y = C->d + ((size_t)A->col_ind[t])*m + r0;
+                a = A->d[t];
+                #pragma omp simd
+                for(i=0; i<nr; i++){
+                    y[i] += a*x[i];
+                }
+            }
+        }
+    }
+    }
+}
+
+
+/* C = A*B ; column major ; uses the first C->ncols columns of B */
 void matrix_matrix_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
+    real_t alpha, beta;
     alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+    if(A->sp != NULL){
+        spmat_matrix_mult(A->sp, B, C);
+        return;
+    }
+    //cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, C->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
 }
 
 
 /* C = A^T*B ; column major */
 void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
+    real_t alpha, beta;
     alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+    if(A->sp != NULL){
+        spmat_matrix_mult(A->spt, B, C);
+        return;
+    }
+    //cblas_rgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_rgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+
+/* C = A*B^T ; column major ; uses the first C->ncols rows of B */
+void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C){
+    real_t alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    //cblas_rgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
+    cblas_rgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, C->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+
+/* C = C - A*B ; column major */
+void matrix_matrix_mult_sub(mat *A, mat *B, mat *C){
+    real_t alpha, beta;
+    alpha = -1.0; beta = 1.0;
+    cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+}
+
+
+/* C(row_offset:row_offset+A->ncols-1,:) = A^T*B ; column major */
+void matrix_transpose_matrix_mult_into_rows(mat *A, mat *B, mat *C, int row_offset){
+    real_t alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    cblas_rgemm(CblasColMajor, CblasTrans, CblasNoTrans, A->ncols, B->ncols, A->nrows, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d + row_offset, C->nrows);
+}
+
+
+/* C = C + A*B(row_offset:row_offset+A->ncols-1,:) ; column major */
+void matrix_matrix_mult_from_rows_add(mat *A, mat *B, int row_offset, mat *C){
+    real_t alpha, beta;
+    alpha = 1.0; beta = 1.0;
+    cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d + row_offset, B->nrows, beta, C->d, C->nrows);
 }
 
 
-/* C = A*B^T ; column major */
-void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C){
-    double alpha, beta;
-    alpha = 1.0; beta = 0.0;
-    //cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+/* B = B*R^{-1} (B*R^{-T} if transpose is nonzero) with R upper triangular ; column major */
+void matrix_upper_triangular_right_solve(mat *R, mat *B, int transpose){
+    cblas_rtrsm(CblasColMajor, CblasRight, CblasUpper, transpose ? CblasTrans : CblasNoTrans, CblasNonUnit, 
+        B->nrows, B->ncols, 1.0, R->d, R->nrows, B->d, B->nrows);
 }
 
 
 /* y = M*x ; column major */
 void matrix_vector_mult(mat *M, vec *x, vec *y){
-    double alpha, beta;
+    real_t alpha, beta;
     alpha = 1.0; beta = 0.0;
-    cblas_dgemv (CblasColMajor, CblasNoTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
+    if(M->sp != NULL){
+        mat X = {x->nrows, 1, x->d, NULL, 0, NULL, NULL}, Y = {y->nrows, 1, y->d, NULL, 0, NULL, NULL};
+        spmat_matrix_mult(M->sp, &X, &Y);
+        return;
+    }
+    cblas_rgemv (CblasColMajor, CblasNoTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
 }
 
 
 /* y = M^T*x ; column major */
 void matrix_transpose_vector_mult(mat *M, vec *x, vec *y){
-    double alpha, beta;
+    real_t alpha, beta;
     alpha = 1.0; beta = 0.0;
-    cblas_dgemv (CblasColMajor, CblasTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
+    if(M->sp != NULL){
+        mat X = {x->nrows, 1, x->d, NULL, 0, NULL, NULL}, Y = {y->nrows, 1, y->d, NULL, 0, NULL, NULL};
+        spmat_matrix_mult(M->spt, &X, &Y);
+        return;
+    }
+    cblas_rgemv (CblasColMajor, CblasTrans, M->nrows, M->ncols, alpha, M->d, M->nrows, x->d, 1, beta, y->d, 1);
 }
 
 
@@ -506,42 +1888,49 @@ void project_vector(vec *v, vec *u, vec *p){
 }
 
 
-/* build orthonormal basis matrix
-Q = Y;
-for j=1:k
-    vj = Q(:,j);
-    for i=1:(j-1)
-        vi = Q(:,i);
-        vj = vj - project_vec(vj,vi);
-    end
-    vj = vj/norm(vj);
-    Q(:,j) = vj;
-end
-*/
+/* build orthonormal basis matrix Q of the range of A by block Gram-Schmidt */
 void build_orthonormal_basis_from_mat(mat *A, mat *Q){
-    int m,n,i,j,ind,num_ortos=2;
-    double vec_norm;
-    vec *vi,*vj,*p;
-    m = A->nrows;
-    n = A->ncols;
-    vi = vector_new(m);
-    vj = vector_new(m);
-    p = vector_new(m);
-    matrix_copy(Q, A);
+    orthonormalize(A, Q, ORTH_BLOCK_GRAM_SCHMIDT);
+}
 
-    for(ind=0; ind<num_ortos; ind++){
-        for(j=0; j<n; j++){
-            matrix_get_col(Q, j, vj);
-            for(i=0; i<j; i++){
-                matrix_get_col(Q, i, vi);
-                project_vector(vj, vi, p);
-                vector_sub(vj, p);
-            }
-            vec_norm = vector_get2norm(vj);
-            vector_scale(vj, 1.0/vec_norm);
-            matrix_set_col(Q, j, vj);
+
+/* A(:,1:k) = A*op(B) in place, a block of rows at a time: the product of a 
+ * block only depends on the same rows of A, so it can be written back over 
+ * them once it is complete */
+void matrix_matrix_mult_in_place(mat *A, mat *B, int k, int transpose){
+    int m,l,r0,nr,j;
+    real_t alpha, beta;
+    alpha = 1.0; beta = 0.0;
+    m = A->nrows; l = A->ncols;
+    mat *T = matrix_new(min(IN_PLACE_BLOCK_ROWS, m), k);
+
+    for(r0=0; r0<m; r0+=IN_PLACE_BLOCK_ROWS){
+        nr = min(IN_PLACE_BLOCK_ROWS, m - r0);
+        if(transpose){
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasTrans, nr, k, l, alpha, A->d + r0, m, B->d, B->nrows, beta, T->d, T->nrows);
+        }
+        else{
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, nr, k, l, alpha, A->d + r0, m, B->d, B->nrows, beta, T->d, T->nrows);
+        }
+        for(j=0; j<k; j++){
+            memcpy(A->d + ((size_t)j)*m + r0, T->d + ((size_t)j)*(T->nrows), nr*sizeof(real_t));
         }
     }
+    A->ncols = k;
+
+    matrix_delete(T);
+}
+
+
+/* set V to a view of columns j0..j0+ncols-1 of M sharing its storage (no copy) */
+void matrix_columns_view(mat *V, mat *M, int j0, int ncols){
+    V->nrows = M->nrows;
+    V->ncols = ncols;
+    V->d = M->d + ((size_t)j0)*(M->nrows);
+    V->mapping = NULL;
+    V->mapping_length = 0;
+    V->sp = NULL;
+    V->spt = NULL;
 }
 
 
@@ -730,6 +2119,22 @@ void append_matrices_horizontally(mat *A, mat *B, mat *C){
 
 
 
+/* A = [A, B] in place; in column major order the new columns 
+ * just go after the existing ones */
+void matrix_append_columns(mat *A, mat *B){
+    size_t old_size = ((size_t)A->nrows)*(A->ncols);
+    size_t new_size = old_size + ((size_t)B->nrows)*(B->ncols);
+    size_t capacity = matrix_data_capacity(A->d);
+    // grow geometrically so that appending a block at a time copies O(final size) overall
+    if(new_size > capacity){
+        A->d = matrix_data_realloc(A->d, max(new_size, 2*capacity));
+    }
+    memcpy(A->d + old_size, B->d, (new_size - old_size)*sizeof(real_t));
+    A->ncols += B->ncols;
+}
+
+
+
 /* append matrices vertically: C = [A; B] */
 void append_matrices_vertically(mat *A, mat *B, mat *C){
     int i,j;
@@ -750,18 +2155,42 @@ void append_matrices_vertically(mat *A, mat *B, mat *C){
 
 
 
-/* calculate percent error between A and B: 100*norm(A - B)/norm(A) */
+/* D = D + alpha*A for dense D and sparse A in CSR */
+static void matrix_add_sparse(mat *D, spmat *A, double alpha){
+    int i;
+    int64_t t;
+    #pragma omp parallel for private(t)
+    for(i=0; i<A->nrows; i++){
+        for(t=A->row_ptr[i]; t<A->row_ptr[i+1]; t++){
+            D->d[((size_t)A->col_ind[t])*(D->nrows) + i] += alpha*A->d[t];
+        }
+    }
+}
+
+
+/* calculate percent error between A and B: 100*norm(A - B)/norm(A); 
+ * either may be sparse */
 double get_percent_error_between_two_mats(mat *A, mat *B){
     int m,n;
-    double normA, normB, normA_minus_B;
+    double normA, normA_minus_B;
     m = A->nrows;
     n = A->ncols;
     mat *A_minus_B = matrix_new(m,n);
-    matrix_copy(A_minus_B, A);
-    matrix_sub(A_minus_B, B);
+    if(A->sp != NULL){
+        matrix_add_sparse(A_minus_B, A->sp, 1.0);
+    }
+    else{
+        matrix_copy(A_minus_B, A);
+    }
+    if(B->sp != NULL){
+        matrix_add_sparse(A_minus_B, B->sp, -1.0);
+    }
+    else{
+        matrix_sub(A_minus_B, B);
+    }
     normA = get_matrix_frobenius_norm(A);
-    normB = get_matrix_frobenius_norm(B);
     normA_minus_B = get_matrix_frobenius_norm(A_minus_B);
+    matrix_delete(A_minus_B);
     return 100.0*normA_minus_B/normA;
 }
 
@@ -817,8 +2246,354 @@ void compute_matrix_column_norms(mat *M, vec *column_norms){
 /* compute eigendecomposition of symmetric matrix M
 */
 void compute_evals_and_evecs_of_symm_matrix(mat *S, vec *evals){
-    //LAPACKE_dsyev( LAPACK_ROW_MAJOR, 'V', 'U', S->nrows, S->d, S->nrows, evals->d);
-    LAPACKE_dsyev( LAPACK_COL_MAJOR, 'V', 'U', S->nrows, S->d, S->ncols, evals->d);
+    compute_top_evals_and_evecs_of_symm_matrix(S, evals, S->nrows);
+}
+
+
+void compute_top_evals_and_evecs_of_symm_matrix(mat *S, vec *evals, int num){
+    int j,n;
+    MKL_INT found;
+    n = S->nrows;
+    num = max(1, min(num, n));
+
+    if(core_eig_solver == EIG_SOLVER_SYEVR){
+        // eigenpairs n-num+1..n into Z, then moved to the end of S and evals
+        mat *Z = matrix_new(n,num);
+        vec *w = vector_new(n);
+        MKL_INT *isuppz = (MKL_INT*)malloc(2*((size_t)num)*sizeof(MKL_INT));
+        LAPACKE_rsyevr( LAPACK_COL_MAJOR, 'V', (num < n) ? 'I' : 'A', 'U', n, S->d, n, 
+            0.0, 0.0, n-num+1, n, 0.0, &found, w->d, Z->d, n, isuppz);
+        memset(S->d, 0, ((size_t)n)*n*sizeof(real_t));
+        memset(evals->d, 0, n*sizeof(real_t));
+        for(j=0; j<found; j++){
+            memcpy(S->d + ((size_t)(n-found+j))*n, Z->d + ((size_t)j)*n, n*sizeof(real_t));
+            evals->d[n-found+j] = w->d[j];
+        }
+        free(isuppz);
+        vector_delete(w);
+        matrix_delete(Z);
+    }
+    else if(core_eig_solver == EIG_SOLVER_SYEVD){
+        LAPACKE_rsyevd( LAPACK_COL_MAJOR, 'V', 'U', n, S->d, n, evals->d);
+    }
+    else{
+        //LAPACKE_rsyev( LAPACK_ROW_MAJOR, 'V', 'U', S->nrows, S->d, S->nrows, evals->d);
+        LAPACKE_rsyev( LAPACK_COL_MAJOR, 'V', 'U', S->nrows, S->d, S->ncols, evals->d);
+    }
+}
+
+
+void compact_QR_factorization_implicit(mat *M, vec *tau, mat *R){
+    int i,j,m,n;
+    m = M->nrows; n = M->ncols;
+    printf("doing QR with implicit Q, m = %d, n = %d\n", m,n);
+
+    LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, M->d, m, tau->d);
+    for(j=0; j<n; j++){
+        for(i=0; i<n; i++){
+            matrix_set_element(R,i,j, i<=j ? matrix_get_element(M,i,j) : 0.0);
+        }
+    }
+}
+
+
+void implicit_Q_matrix_mult(mat *QR, vec *tau, mat *X, mat *C){
+    int j,m,n,c;
+    m = QR->nrows; n = QR->ncols; c = C->ncols;
+
+    // C = [X(1:n,:); 0], then C = Q_full*C
+    memset(C->d, 0, ((size_t)m)*c*sizeof(real_t));
+    for(j=0; j<c; j++){
+        memcpy(C->d + ((size_t)j)*m, X->d + ((size_t)j)*(X->nrows), n*sizeof(real_t));
+    }
+    LAPACKE_rormqr(LAPACK_COL_MAJOR, 'L', 'N', m, c, n, QR->d, m, tau->d, C->d, m);
+}
+
+
+/* one CholeskyQR pass on M (mxn): G = M^T M + shift*I = R^T R, M = M R^-1; 
+ * returns the potrf info, M is unchanged when it is nonzero */
+static int cholesky_QR_pass(mat *M, mat *G, int shifted){
+    int i, m, n, info;
+    double trace, shift;
+    m = M->nrows; n = M->ncols;
+
+    cblas_rsyrk(CblasColMajor, CblasUpper, CblasTrans, n, m, 1.0, M->d, m, 0.0, G->d, n);
+    if(shifted){
+        // shift 11(mn + n(n+1)) u norm(M)_2^2, with norm(M)_F^2 = trace(G) as the bound
+        trace = 0;
+        for(i=0; i<n; i++){
+            trace += matrix_get_element(G,i,i);
+        }
+        shift = 11.0*(((double)m)*n + ((double)n)*(n+1))*(REAL_EPSILON/2)*trace;
+        for(i=0; i<n; i++){
+            matrix_set_element(G,i,i, matrix_get_element(G,i,i) + shift);
+        }
+    }
+    info = LAPACKE_rpotrf(LAPACK_COL_MAJOR, 'U', n, G->d, n);
+    if(info != 0){
+        return info;
+    }
+    cblas_rtrsm(CblasColMajor, CblasRight, CblasUpper, CblasNoTrans, CblasNonUnit, m, n, 1.0, G->d, n, M->d, m);
+    return 0;
+}
+
+
+/* Y = Y - Q*(Q^T*Y) with C (kxb) for Q^T*Y */
+static void project_out_basis(mat *Q, mat *Y, mat *C){
+    matrix_transpose_matrix_mult(Q, Y, C);
+    matrix_matrix_mult_sub(Q, C, Y);
+}
+
+
+void orthonormalize_against_basis(mat *Q, mat *Y, int orth_type){
+    double norm_before, norm_after;
+    mat *C;
+
+    if(Q == NULL || Q->ncols == 0){
+        orthonormalize_in_place(Y, orth_type);
+        return;
+    }
+
+    C = matrix_new(Q->ncols, Y->ncols);
+    norm_before = get_matrix_frobenius_norm(Y);
+    project_out_basis(Q, Y, C);
+    norm_after = get_matrix_frobenius_norm(Y);
+    orthonormalize_in_place(Y, orth_type);
+
+    // much of Y was in the range of Q: what is left carries the rounding errors 
+    // of the projection, which the second pass removes
+    if(norm_after < BCGS_REORTH_TOL*norm_before){
+        project_out_basis(Q, Y, C);
+        orthonormalize_in_place(Y, orth_type);
+    }
+    matrix_delete(C);
+}
+
+
+/* BCGS2 over blocks of columns of M, each against all the blocks before it */
+static void block_gram_schmidt_in_place(mat *M){
+    int j0, nb;
+    mat Qprev, Yj;
+
+    for(j0=0; j0<M->ncols; j0+=BCGS_BLOCK_COLUMNS){
+        nb = min(BCGS_BLOCK_COLUMNS, M->ncols - j0);
+        matrix_columns_view(&Qprev, M, 0, j0);
+        matrix_columns_view(&Yj, M, j0, nb);
+        orthonormalize_against_basis(&Qprev, &Yj, ORTH_CHOLESKY_QR2);
+    }
+}
+
+
+void orthonormalize_in_place(mat *M, int orth_type){
+    int pass, num_passes, info;
+    mat *G;
+
+    if(orth_type == ORTH_BLOCK_GRAM_SCHMIDT && M->nrows >= M->ncols){
+        block_gram_schmidt_in_place(M);
+        return;
+    }
+    if((orth_type != ORTH_CHOLESKY_QR2 && orth_type != ORTH_SHIFTED_CHOLESKY_QR3) || M->nrows < M->ncols){
+        QR_factorization_getQ_in_place(M);
+        return;
+    }
+
+    // CholeskyQR2 is two plain passes, shifted CholeskyQR3 puts a shifted one in front
+    G = matrix_new(M->ncols, M->ncols);
+    num_passes = (orth_type == ORTH_SHIFTED_CHOLESKY_QR3) ? 3 : 2;
+    for(pass=0; pass<num_passes; pass++){
+        info = cholesky_QR_pass(M, G, orth_type == ORTH_SHIFTED_CHOLESKY_QR3 && pass == 0);
+        if(info != 0){
+            // M still spans the same space, finish with Householder
+            printf("Cholesky QR pass %d failed (info = %d), falling back to Householder QR\n", pass+1, info);
+            QR_factorization_getQ_in_place(M);
+            break;
+        }
+    }
+    matrix_delete(G);
+}
+
+
+void orthonormalize(mat *M, mat *Q, int orth_type){
+    matrix_copy(Q,M);
+    orthonormalize_in_place(Q, orth_type);
+}
+
+
+/* number of row blocks for the TSQR of an mxn matrix: one per thread, each with 
+ * at least TSQR_MIN_BLOCK_ROWS_PER_COLUMN*n rows; 1 means Householder QR is used */
+int tall_skinny_QR_num_blocks(int m, int n){
+    int64_t b;
+    if(n < 1 || omp_in_parallel()){
+        return 1;
+    }
+    b = m/(((int64_t)TSQR_MIN_BLOCK_ROWS_PER_COLUMN)*n);
+    return (int)max(1, min(b, (int64_t)omp_get_max_threads()));
+}
+
+
+/* [Q,R] = qr(M,'0') by TSQR with Q overwriting M, R (nxn) may be NULL: 
+ * each row block is factored by its own thread, the nxn R factors are reduced 
+ * pairwise in a binary tree ([R_a; R_b] = Q_ab R_ab), and Q is rebuilt in 
+ * parallel by pushing the tree factors back down to the blocks */
+void tall_skinny_QR_factorization_in_place(mat *M, mat *R){
+    int i, j, p, m, n, b, level, num_levels, count, next_count, nr, r0, c0, nc;
+    int *block_start, *level_count;
+    real_t **taus, **Rs, **Rs_next, **Qts, **Qts_next, **pairs, **swap;
+    real_t *stack, *Rp, *buf;
+    size_t nn;
+
+    m = M->nrows; n = M->ncols;
+    b = tall_skinny_QR_num_blocks(m,n);
+    if(b < 2){
+        vec *tau = vector_new(n);
+        LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, M->d, m, tau->d);
+        if(R != NULL){
+            for(j=0; j<n; j++){
+                for(i=0; i<n; i++){
+                    matrix_set_element(R,i,j, i<=j ? matrix_get_element(M,i,j) : 0.0);
+                }
+            }
+        }
+        LAPACKE_rorgqr(LAPACK_COL_MAJOR, m, n, n, M->d, m, tau->d);
+        vector_delete(tau);
+        return;
+    }
+    nn = ((size_t)n)*n;
+
+    block_start = (int*)malloc((b+1)*sizeof(int));
+    for(i=0; i<=b; i++){
+        block_start[i] = (int)(((int64_t)i)*m/b);
+    }
+
+    // levels of the reduction tree: level 0 has the b blocks, the top level one node
+    num_levels = 1;
+    for(count=b; count>1; count=(count+1)/2){
+        num_levels++;
+    }
+    level_count = (int*)malloc(num_levels*sizeof(int));
+    level_count[0] = b;
+    for(level=1; level<num_levels; level++){
+        level_count[level] = (level_count[level-1] + 1)/2;
+    }
+
+    taus = (real_t**)malloc(b*sizeof(real_t*));
+    Rs = (real_t**)malloc(b*sizeof(real_t*));
+    Rs_next = (real_t**)malloc(b*sizeof(real_t*));
+    Qts = (real_t**)malloc(b*sizeof(real_t*));
+    Qts_next = (real_t**)malloc(b*sizeof(real_t*));
+    // Q factor (2n x n) of node p of level l is pairs[l*b + p], NULL when it has one child
+    pairs = (real_t**)calloc(((size_t)num_levels)*b, sizeof(real_t*));
+    for(i=0; i<b; i++){
+        taus[i] = (real_t*)malloc(n*sizeof(real_t));
+        Rs[i] = (real_t*)calloc(nn, sizeof(real_t));
+        Rs_next[i] = (real_t*)calloc(nn, sizeof(real_t));
+        Qts[i] = (real_t*)calloc(nn, sizeof(real_t));
+        Qts_next[i] = (real_t*)calloc(nn, sizeof(real_t));
+    }
+
+    // factor the row blocks in place, keeping their R
+    #pragma omp parallel shared(M,m,n,b,block_start,taus,Rs) private(i,j,r0,nr) 
+    {
+    #pragma omp for schedule(static,1)
+    for(i=0; i<b; i++){
+        r0 = block_start[i];
+        nr = block_start[i+1] - r0;
+        LAPACKE_rgeqrf(LAPACK_COL_MAJOR, nr, n, M->d + r0, m, taus[i]);
+        for(j=0; j<n; j++){
+            memcpy(Rs[i] + ((size_t)j)*n, M->d + ((size_t)j)*m + r0, (j+1)*sizeof(real_t));
+        }
+    }
+    }
+
+    // reduce pairs of R factors up the tree
+    for(level=1; level<num_levels; level++){
+        count = level_count[level-1];
+        next_count = level_count[level];
+        #pragma omp parallel shared(level,count,next_count,n,nn,b,Rs,Rs_next,pairs) private(p,j,stack,Rp) 
+        {
+        #pragma omp for schedule(static,1)
+        for(p=0; p<next_count; p++){
+            Rp = Rs_next[p];
+            if(2*p+1 >= count){
+                memcpy(Rp, Rs[2*p], nn*sizeof(real_t));
+                continue;
+            }
+            // stack = [R_2p; R_2p+1] is factored and overwritten by its Q
+            stack = (real_t*)malloc(2*nn*sizeof(real_t));
+            real_t *tau = (real_t*)malloc(n*sizeof(real_t));
+            for(j=0; j<n; j++){
+                memcpy(stack + ((size_t)j)*2*n, Rs[2*p] + ((size_t)j)*n, n*sizeof(real_t));
+                memcpy(stack + ((size_t)j)*2*n + n, Rs[2*p+1] + ((size_t)j)*n, n*sizeof(real_t));
+            }
+            LAPACKE_rgeqrf(LAPACK_COL_MAJOR, 2*n, n, stack, 2*n, tau);
+            memset(Rp, 0, nn*sizeof(real_t));
+            for(j=0; j<n; j++){
+                memcpy(Rp + ((size_t)j)*n, stack + ((size_t)j)*2*n, (j+1)*sizeof(real_t));
+            }
+            LAPACKE_rorgqr(LAPACK_COL_MAJOR, 2*n, n, n, stack, 2*n, tau);
+            pairs[((size_t)level)*b + p] = stack;
+            free(tau);
+        }
+        }
+        swap = Rs; Rs = Rs_next; Rs_next = swap;
+    }
+    if(R != NULL){
+        memcpy(R->d, Rs[0], nn*sizeof(real_t));
+    }
+
+    // push the tree factors down: the root gets the identity, the children of 
+    // a pair get the top and bottom halves of its Q times the parent's factor
+    for(j=0; j<n; j++){
+        Qts[0][((size_t)j)*n + j] = 1.0;
+    }
+    for(level=num_levels-1; level>=1; level--){
+        count = level_count[level];
+        #pragma omp parallel shared(level,count,n,nn,b,Qts,Qts_next,pairs) private(p,stack) 
+        {
+        #pragma omp for schedule(static,1)
+        for(p=0; p<count; p++){
+            stack = pairs[((size_t)level)*b + p];
+            if(stack == NULL){
+                memcpy(Qts_next[2*p], Qts[p], nn*sizeof(real_t));
+                continue;
+            }
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0, stack, 2*n, Qts[p], n, 0.0, Qts_next[2*p], n);
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0, stack + n, 2*n, Qts[p], n, 0.0, Qts_next[2*p+1], n);
+        }
+        }
+        swap = Qts; Qts = Qts_next; Qts_next = swap;
+    }
+
+    // Q of each block times its tree factor, a chunk of rows at a time
+    #pragma omp parallel shared(M,m,n,b,block_start,taus,Qts) private(i,j,r0,nr,c0,nc,buf) 
+    {
+    buf = (real_t*)malloc(((size_t)TSQR_APPLY_BLOCK_ROWS)*n*sizeof(real_t));
+    #pragma omp for schedule(static,1)
+    for(i=0; i<b; i++){
+        r0 = block_start[i];
+        nr = block_start[i+1] - r0;
+        LAPACKE_rorgqr(LAPACK_COL_MAJOR, nr, n, n, M->d + r0, m, taus[i]);
+        for(c0=0; c0<nr; c0+=TSQR_APPLY_BLOCK_ROWS){
+            nc = min(TSQR_APPLY_BLOCK_ROWS, nr - c0);
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, nc, n, n, 1.0, M->d + r0 + c0, m, Qts[i], n, 0.0, buf, TSQR_APPLY_BLOCK_ROWS);
+            for(j=0; j<n; j++){
+                memcpy(M->d + ((size_t)j)*m + r0 + c0, buf + ((size_t)j)*TSQR_APPLY_BLOCK_ROWS, nc*sizeof(real_t));
+            }
+        }
+    }
+    free(buf);
+    }
+
+    // clean up
+    for(i=0; i<b; i++){
+        free(taus[i]); free(Rs[i]); free(Rs_next[i]); free(Qts[i]); free(Qts_next[i]);
+    }
+    for(i=0; i<num_levels*b; i++){
+        free(pairs[i]);
+    }
+    free(taus); free(Rs); free(Rs_next); free(Qts); free(Qts_next); free(pairs);
+    free(block_start);
+    free(level_count);
 }
 
 
@@ -829,31 +2604,32 @@ void compact_QR_factorization(mat *M, mat *Q, mat *R){
     m = M->nrows; n = M->ncols;
     k = min(m,n);
     printf("doing QR with m = %d, n = %d, k = %d\n", m,n,k);
-    mat *R_full = matrix_new(m,n);
-    matrix_copy(R_full,M);
+    if(tall_skinny_QR_num_blocks(m,n) > 1){
+        matrix_copy(Q,M);
+        tall_skinny_QR_factorization_in_place(Q,R);
+        return;
+    }
     //vec *tau = vector_new(n);
     vec *tau = vector_new(k);
 
-    // get R
+    // get R; the factorization is done in Q, no separate copy R_full
     //printf("get R..\n");
-    //LAPACKE_dgeqrf(CblasColMajor, m, n, R_full->d, n, tau->d);
-    LAPACKE_dgeqrf(LAPACK_COL_MAJOR, R_full->nrows, R_full->ncols, R_full->d, R_full->nrows, tau->d);
+    matrix_copy(Q,M);
+    LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d);
     
     for(i=0; i<k; i++){
         for(j=0; j<k; j++){
             if(j>=i){
-                matrix_set_element(R,i,j,matrix_get_element(R_full,i,j));
+                matrix_set_element(R,i,j,matrix_get_element(Q,i,j));
             }
         }
     }
 
     // get Q
-    matrix_copy(Q,R_full); 
     //printf("dorgqr..\n");
-    LAPACKE_dorgqr(LAPACK_COL_MAJOR, Q->nrows, Q->ncols, min(Q->ncols,Q->nrows), Q->d, Q->nrows, tau->d);
+    LAPACKE_rorgqr(LAPACK_COL_MAJOR, Q->nrows, Q->ncols, min(Q->ncols,Q->nrows), Q->d, Q->nrows, tau->d);
 
     // clean up
-    matrix_delete(R_full);
     vector_delete(tau);
 }
 
@@ -866,10 +2642,14 @@ void QR_factorization_getQ(mat *M, mat *Q){
     m = M->nrows; n = M->ncols;
     k = min(m,n);
     matrix_copy(Q,M);
+    if(tall_skinny_QR_num_blocks(m,n) > 1){
+        tall_skinny_QR_factorization_in_place(Q,NULL);
+        return;
+    }
     vec *tau = vector_new(k);
 
-    LAPACKE_dgeqrf(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d);
-    LAPACKE_dorgqr(LAPACK_COL_MAJOR, m, n, n, Q->d, m, tau->d);
+    LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d);
+    LAPACKE_rorgqr(LAPACK_COL_MAJOR, m, n, n, Q->d, m, tau->d);
 
     // clean up
     vector_delete(tau);
@@ -879,27 +2659,195 @@ void QR_factorization_getQ(mat *M, mat *Q){
 
 
 
+/* Q from qr(M,'0') overwriting M */
+void QR_factorization_getQ_in_place(mat *M){
+    int m,n;
+    m = M->nrows; n = M->ncols;
+    if(tall_skinny_QR_num_blocks(m,n) > 1){
+        tall_skinny_QR_factorization_in_place(M,NULL);
+        return;
+    }
+    vec *tau = vector_new(n);
+
+    LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, M->d, m, tau->d);
+    LAPACKE_rorgqr(LAPACK_COL_MAJOR, m, n, n, M->d, m, tau->d);
+
+    vector_delete(tau);
+}
+
+
+/* [Q,R] = qr(M,'0') with Q overwriting M; R is nxn */
+void compact_QR_factorization_in_place(mat *M, mat *R){
+    int i,j,m,n;
+    m = M->nrows; n = M->ncols;
+    if(tall_skinny_QR_num_blocks(m,n) > 1){
+        tall_skinny_QR_factorization_in_place(M,R);
+        return;
+    }
+    vec *tau = vector_new(n);
+
+    LAPACKE_rgeqrf(LAPACK_COL_MAJOR, m, n, M->d, m, tau->d);
+    for(j=0; j<n; j++){
+        for(i=0; i<n; i++){
+            matrix_set_element(R,i,j, i<=j ? matrix_get_element(M,i,j) : 0.0);
+        }
+    }
+    LAPACKE_rorgqr(LAPACK_COL_MAJOR, m, n, n, M->d, m, tau->d);
+
+    vector_delete(tau);
+}
+
+
+
+/* one-sided Jacobi SVD of M (mxn, m >= n) with U overwriting M; the singular 
+ * values come out sorted and scaled by stat[0] (1 unless they would overflow) */
+static void singular_value_decomposition_jacobi_in_place(mat *M, vec *svals, mat *Vt){
+    int i,m,n;
+    real_t stat[6];
+    m = M->nrows; n = M->ncols;
+    mat *V = matrix_new(n,n);
+
+    LAPACKE_rgesvj( LAPACK_COL_MAJOR, 'G', 'U', 'V', m, n, M->d, m, svals->d, 0, V->d, n, stat );
+    if(stat[0] != 1.0){
+        for(i=0; i<n; i++){
+            svals->d[i] *= stat[0];
+        }
+    }
+    matrix_build_transpose(Vt, V);
+
+    matrix_delete(V);
+}
+
+
 /* computes SVD: M = U*S*Vt; note Vt = V^T */
 void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt){
     int m,n,k;
     m = M->nrows; n = M->ncols;
     k = min(m,n);
-    vec * work = vector_new(2*max(3*min(m, n)+max(m, n), 5*min(m,n)));
     vec * svals = vector_new(k);
 
-    LAPACKE_dgesvd( LAPACK_COL_MAJOR, 'S', 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k, work->d );
+    if(core_svd_solver == SVD_SOLVER_JACOBI && m >= n){
+        singular_value_decomposition_jacobi_in_place(M, svals, Vt);
+        memcpy(U->d, M->d, ((size_t)m)*n*sizeof(real_t));
+    }
+    else if(core_svd_solver != SVD_SOLVER_GESVD){
+        LAPACKE_rgesdd( LAPACK_COL_MAJOR, 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k );
+    }
+    else{
+        vec * work = vector_new(2*max(3*min(m, n)+max(m, n), 5*min(m,n)));
+        LAPACKE_rgesvd( LAPACK_COL_MAJOR, 'S', 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k, work->d );
+        vector_delete(work);
+    }
 
     initialize_diagonal_matrix(S, svals);
 
-    vector_delete(work);
     vector_delete(svals);
 }
 
 
 
+/* M = U*diag(svals)*Vt, U (mxn) is returned in M; for m >= n the solver set by 
+ * core_solvers_configure is used, with jobz = 'O' for divide and conquer */
+void singular_value_decomposition_in_place(mat *M, vec *svals, mat *Vt){
+    int m,n,k;
+    m = M->nrows; n = M->ncols;
+    k = min(m,n);
+
+    if(core_svd_solver == SVD_SOLVER_JACOBI && m >= n){
+        singular_value_decomposition_jacobi_in_place(M, svals, Vt);
+        return;
+    }
+
+    if(core_svd_solver == SVD_SOLVER_GESDD && m >= n){
+        LAPACKE_rgesdd( LAPACK_COL_MAJOR, 'O', m, n, M->d, m, svals->d, NULL, m, Vt->d, k );
+        return;
+    }
+
+    vec * superb = vector_new(k);
+
+    LAPACKE_rgesvd( LAPACK_COL_MAJOR, 'O', 'S', m, n, M->d, m, svals->d, NULL, m, Vt->d, k, superb->d );
+
+    vector_delete(superb);
+}
+
+
+/* LAPACK workspace (number of entries) for the _with_work versions of the 
+ * QR factorizations of an mxn matrix, found by workspace queries */
+int QR_factorization_workspace_size(int m, int n){
+    real_t lwork_geqrf, lwork_orgqr;
+    int k = min(m,n);
+    LAPACKE_rgeqrf_work(LAPACK_COL_MAJOR, m, n, NULL, m, NULL, &lwork_geqrf, -1);
+    LAPACKE_rorgqr_work(LAPACK_COL_MAJOR, m, k, k, NULL, m, NULL, &lwork_orgqr, -1);
+    return max(1, (int)max(lwork_geqrf, lwork_orgqr));
+}
+
+
+/* LAPACK workspace for singular_value_decomposition_with_work of an mxn matrix */
+int singular_value_decomposition_workspace_size(int m, int n){
+    real_t lwork;
+    int k = min(m,n);
+    LAPACKE_rgesvd_work(LAPACK_COL_MAJOR, 'S', 'S', m, n, NULL, m, NULL, NULL, m, NULL, k, &lwork, -1);
+    return max(1, (int)lwork);
+}
+
+
+/* LAPACK workspace for compute_evals_and_evecs_of_symm_matrix_with_work of an nxn matrix */
+int symmetric_eigendecomposition_workspace_size(int n){
+    real_t lwork;
+    LAPACKE_rsyev_work(LAPACK_COL_MAJOR, 'V', 'U', n, NULL, n, NULL, &lwork, -1);
+    return max(1, (int)lwork);
+}
+
+
+/* QR_factorization_getQ with caller owned tau (min(m,n)) and workspace, no allocation */
+void QR_factorization_getQ_with_work(mat *M, mat *Q, vec *tau, real_t *work, int lwork){
+    int m,n;
+    m = M->nrows; n = M->ncols;
+    matrix_copy(Q,M);
+    LAPACKE_rgeqrf_work(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d, work, lwork);
+    LAPACKE_rorgqr_work(LAPACK_COL_MAJOR, m, n, n, Q->d, m, tau->d, work, lwork);
+}
+
+
+/* compact_QR_factorization with caller owned tau and workspace, no allocation; 
+ * Q holds the factored M until dorgqr so no copy R_full is needed */
+void compact_QR_factorization_with_work(mat *M, mat *Q, mat *R, vec *tau, real_t *work, int lwork){
+    int i,j,m,n,k;
+    m = M->nrows; n = M->ncols;
+    k = min(m,n);
+    matrix_copy(Q,M);
+    LAPACKE_rgeqrf_work(LAPACK_COL_MAJOR, m, n, Q->d, m, tau->d, work, lwork);
+
+    // R is the upper triangle, the lower one is cleared since R may be reused
+    for(j=0; j<k; j++){
+        for(i=0; i<k; i++){
+            matrix_set_element(R,i,j, i<=j ? matrix_get_element(Q,i,j) : 0.0);
+        }
+    }
+
+    LAPACKE_rorgqr_work(LAPACK_COL_MAJOR, m, k, k, Q->d, m, tau->d, work, lwork);
+}
+
+
+/* computes SVD: M = U*diag(svals)*Vt with caller owned workspace; M is destroyed */
+void singular_value_decomposition_with_work(mat *M, mat *U, vec *svals, mat *Vt, real_t *work, int lwork){
+    int m,n,k;
+    m = M->nrows; n = M->ncols;
+    k = min(m,n);
+    LAPACKE_rgesvd_work(LAPACK_COL_MAJOR, 'S', 'S', m, n, M->d, m, svals->d, U->d, m, Vt->d, k, work, lwork);
+}
+
+
+/* compute_evals_and_evecs_of_symm_matrix with caller owned workspace */
+void compute_evals_and_evecs_of_symm_matrix_with_work(mat *S, vec *evals, real_t *work, int lwork){
+    LAPACKE_rsyev_work(LAPACK_COL_MAJOR, 'V', 'U', S->nrows, S->d, S->nrows, evals->d, work, lwork);
+}
+
+
+
 void form_svd_product_matrix(mat *U, mat *S, mat *V, mat *P){
     int k,m,n;
-    double alpha, beta;
+    real_t alpha, beta;
     alpha = 1.0; beta = 0.0;
     m = P->nrows;
     n = P->ncols;
@@ -911,5 +2859,168 @@ void form_svd_product_matrix(mat *U, mat *S, mat *V, mat *P){
 
     // form P = U*S*V^T
     matrix_matrix_mult(U,SVt,P);
+
+    matrix_delete(SVt);
+}
+
+
+/* dense panel Mj of columns j0..j0+nc-1 of M: a view for dense M, 
+ * scattered from the CSC copy into the mxnc buffer P for sparse M */
+static void matrix_get_column_panel(mat *M, int j0, int nc, mat *P, mat *Mj){
+    int j;
+    int64_t t;
+    if(M->sp == NULL){
+        matrix_columns_view(Mj, M, j0, nc);
+        return;
+    }
+    matrix_columns_view(Mj, P, 0, nc);
+    memset(Mj->d, 0, ((size_t)M->nrows)*nc*sizeof(real_t));
+    for(j=0; j<nc; j++){
+        for(t=M->spt->row_ptr[j0+j]; t<M->spt->row_ptr[j0+j+1]; t++){
+            Mj->d[((size_t)j)*(M->nrows) + M->spt->col_ind[t]] = M->spt->d[t];
+        }
+    }
+}
+
+
+/* squared residual norm(M - U*S*V^T)_F^2, also returns norm(M)_F^2 */
+static double get_svd_residual_squared(mat *M, mat *U, mat *S, mat *V, double *normM_squared){
+    int m,n,k,j0,nc,nb;
+    int64_t i;
+    double trace, normP_squared, residual_squared, panel_sum, c, y, t;
+    mat Mj, Tj;
+    m = M->nrows; n = M->ncols; k = S->nrows;
+    nb = min(RESIDUAL_PANEL_COLUMNS, n);
+
+    // the mxnb panel buffer is only needed for sparse M or the explicit sum
+    mat *P = (M->sp != NULL) ? matrix_new(m,nb) : NULL;
+    mat *T = matrix_new(k,nb);
+    mat *C = matrix_new(k,k);
+
+    // C = U^T M V accumulated over panels: C += (U^T Mj) V(j0:j0+nc-1,:)
+    for(j0=0; j0<n; j0+=nb){
+        nc = min(nb, n - j0);
+        matrix_get_column_panel(M, j0, nc, P, &Mj);
+        matrix_columns_view(&Tj, T, 0, nc);
+        matrix_transpose_matrix_mult(U, &Mj, &Tj);
+        cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, k, k, nc, 1.0, T->d, k, V->d + j0, n, 1.0, C->d, k);
+    }
+    *normM_squared = pow(get_matrix_frobenius_norm(M),2);
+
+    // tr(S^T C) and norm(U S V^T)^2 = sum((U^T U) .* (S (V^T V) S^T))
+    mat *GU = matrix_new(k,k);
+    mat *GV = matrix_new(k,k);
+    mat *SGV = matrix_new(k,k);
+    matrix_transpose_matrix_mult(U, U, GU);
+    matrix_transpose_matrix_mult(V, V, GV);
+    matrix_matrix_mult(S, GV, SGV);
+    matrix_matrix_transpose_mult(SGV, S, GV);
+    trace = 0; normP_squared = 0;
+    for(i=0; i<((int64_t)k)*k; i++){
+        trace += S->d[i]*C->d[i];
+        normP_squared += GU->d[i]*GV->d[i];
+    }
+    residual_squared = *normM_squared - 2*trace + normP_squared;
+
+    if(residual_squared < RESIDUAL_CANCELLATION_TOL*(*normM_squared)){
+        // R = Mj - U*(S*V(j0:j0+nc-1,:)^T) panel by panel, the panel 
+        // sums are accumulated with Kahan summation
+        printf("residual is small, summing it explicitly over panels\n");
+        if(P == NULL){
+            P = matrix_new(m,nb);
+        }
+        residual_squared = 0; c = 0;
+        for(j0=0; j0<n; j0+=nb){
+            nc = min(nb, n - j0);
+            matrix_get_column_panel(M, j0, nc, P, &Mj);
+            if(Mj.d != P->d){
+                memcpy(P->d, Mj.d, ((size_t)m)*nc*sizeof(real_t));
+            }
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasTrans, k, nc, k, 1.0, S->d, k, V->d + j0, n, 0.0, T->d, k);
+            cblas_rgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, m, nc, k, -1.0, U->d, m, T->d, k, 1.0, P->d, m);
+
+            panel_sum = 0;
+            #pragma omp parallel shared(P,m,nc) private(i) 
+            {
+            #pragma omp for reduction(+:panel_sum)
+            for(i=0; i<((int64_t)m)*nc; i++){
+                panel_sum += P->d[i]*P->d[i];
+            }
+            }
+            y = panel_sum - c;
+            t = residual_squared + y;
+            c = (t - residual_squared) - y;
+            residual_squared = t;
+        }
+    }
+
+    if(P != NULL){
+        matrix_delete(P);
+    }
+    matrix_delete(T);
+    matrix_delete(C);
+    matrix_delete(GU);
+    matrix_delete(GV);
+    matrix_delete(SGV);
+    return max(residual_squared, 0);
+}
+
+
+double get_svd_residual_frobenius_norm(mat *M, mat *U, mat *S, mat *V){
+    double normM_squared;
+    return sqrt(get_svd_residual_squared(M, U, S, V, &normM_squared));
+}
+
+
+double get_percent_error_of_svd(mat *M, mat *U, mat *S, mat *V){
+    double normM_squared, residual_squared;
+    residual_squared = get_svd_residual_squared(M, U, S, V, &normM_squared);
+    return 100.0*sqrt(residual_squared/normM_squared);
+}
+
+
+/* the probes see E only through E*W = M*W - U*(S*(V^T*W)) */
+void estimate_svd_error(mat *M, mat *U, mat *S, mat *V, int r, double delta, double *spectral_bound, double *frobenius_estimate, double *frobenius_bound){
+    int i,j,k;
+    double colnorm_squared, max_norm_squared, sum_squares, x, lo, hi;
+    k = S->nrows;
+
+    mat *W = matrix_new(M->ncols, r);
+    mat *Y = matrix_new(M->nrows, r);
+    mat *T = matrix_new(k, r);
+    mat *ST = matrix_new(k, r);
+    initialize_random_matrix(W);
+    matrix_matrix_mult(M, W, Y);
+    matrix_transpose_matrix_mult(V, W, T);
+    matrix_matrix_mult(S, T, ST);
+    matrix_matrix_mult_sub(U, ST, Y);
+
+    max_norm_squared = 0; sum_squares = 0;
+    for(i=0; i<r; i++){
+        colnorm_squared = get_matrix_column_norm_squared(Y, i);
+        max_norm_squared = max(max_norm_squared, colnorm_squared);
+        sum_squares += colnorm_squared;
+    }
+    *spectral_bound = 10.0*sqrt(2.0/M_PI)*sqrt(max_norm_squared);
+    *frobenius_estimate = sqrt(sum_squares/r);
+
+    // solve (r/2)(log(x) + 1 - x) = log(delta) for x in (0,1) by bisection, 
+    // the left side increases from -inf to 0
+    lo = 0; hi = 1;
+    for(j=0; j<100; j++){
+        x = 0.5*(lo + hi);
+        if(0.5*r*(log(x) + 1 - x) < log(delta)){
+            lo = x;
+        }
+        else{
+            hi = x;
+        }
+    }
+    *frobenius_bound = (*frobenius_estimate)/sqrt(lo);
+
+    matrix_delete(W);
+    matrix_delete(Y);
+    matrix_delete(T);
+    matrix_delete(ST);
 }
 
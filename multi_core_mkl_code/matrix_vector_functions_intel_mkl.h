@@ -1,28 +1,291 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
 #include "mkl.h"
 #include "mkl_lapacke.h"
 #include "mkl_vsl.h"
 
+/* working precision of mat, vec and spmat data: double, or float when compiled 
+ * with -DRSVD_SINGLE_PRECISION (see compile.sh); the code is written once against 
+ * real_t and the r-named BLAS, LAPACK and VSL routines below so that the two 
+ * versions cannot drift apart. Norms, errors and other reductions stay double */
+#ifdef RSVD_SINGLE_PRECISION
+typedef float real_t;
+#define RSVD_PRECISION_NAME "single"
+#define MATRIX_FILE_DTYPE_NATIVE MATRIX_FILE_DTYPE_FLOAT32
+#define REAL_EPSILON FLT_EPSILON
+#define cblas_rgemm cblas_sgemm
+#define cblas_rgemv cblas_sgemv
+#define cblas_rcopy cblas_scopy
+#define cblas_rtrsm cblas_strsm
+#define cblas_rsyrk cblas_ssyrk
+#define LAPACKE_rgeqrf LAPACKE_sgeqrf
+#define LAPACKE_rorgqr LAPACKE_sorgqr
+#define LAPACKE_rgesvd LAPACKE_sgesvd
+#define LAPACKE_rsyev LAPACKE_ssyev
+#define LAPACKE_rpotrf LAPACKE_spotrf
+#define LAPACKE_rormqr LAPACKE_sormqr
+#define LAPACKE_rgesdd LAPACKE_sgesdd
+#define LAPACKE_rgesvj LAPACKE_sgesvj
+#define LAPACKE_rsyevd LAPACKE_ssyevd
+#define LAPACKE_rsyevr LAPACKE_ssyevr
+#define LAPACKE_rgeqrf_work LAPACKE_sgeqrf_work
+#define LAPACKE_rorgqr_work LAPACKE_sorgqr_work
+#define LAPACKE_rgesvd_work LAPACKE_sgesvd_work
+#define LAPACKE_rsyev_work LAPACKE_ssyev_work
+#define vrRngGaussian vsRngGaussian
+#else
+typedef double real_t;
+#define RSVD_PRECISION_NAME "double"
+#define MATRIX_FILE_DTYPE_NATIVE MATRIX_FILE_DTYPE_FLOAT64
+#define REAL_EPSILON DBL_EPSILON
+#define cblas_rgemm cblas_dgemm
+#define cblas_rgemv cblas_dgemv
+#define cblas_rcopy cblas_dcopy
+#define cblas_rtrsm cblas_dtrsm
+#define cblas_rsyrk cblas_dsyrk
+#define LAPACKE_rgeqrf LAPACKE_dgeqrf
+#define LAPACKE_rorgqr LAPACKE_dorgqr
+#define LAPACKE_rgesvd LAPACKE_dgesvd
+#define LAPACKE_rsyev LAPACKE_dsyev
+#define LAPACKE_rpotrf LAPACKE_dpotrf
+#define LAPACKE_rormqr LAPACKE_dormqr
+#define LAPACKE_rgesdd LAPACKE_dgesdd
+#define LAPACKE_rgesvj LAPACKE_dgesvj
+#define LAPACKE_rsyevd LAPACKE_dsyevd
+#define LAPACKE_rsyevr LAPACKE_dsyevr
+#define LAPACKE_rgeqrf_work LAPACKE_dgeqrf_work
+#define LAPACKE_rorgqr_work LAPACKE_dorgqr_work
+#define LAPACKE_rgesvd_work LAPACKE_dgesvd_work
+#define LAPACKE_rsyev_work LAPACKE_dsyev_work
+#define vrRngGaussian vdRngGaussian
+#endif
+
 #define SEED    777
 #define BRNG    VSL_BRNG_MCG31
 #define METHOD  VSL_RNG_METHOD_GAUSSIAN_ICDF
 
+#define TRANSPOSE_BLOCK_SIZE 64
+
+/* allocator for mat/vec data: alignment in bytes (a power of two, at least 64) 
+ * and huge page mode, both can also be set at run time by matrix_alloc_configure */
+#ifndef MATRIX_ALIGNMENT
+#define MATRIX_ALIGNMENT 64
+#endif
+#define MATRIX_HUGE_PAGES_NONE 0
+#define MATRIX_HUGE_PAGES_TRANSPARENT 1  /* 2 MB aligned blocks with madvise(MADV_HUGEPAGE) */
+#define MATRIX_HUGE_PAGES_EXPLICIT 2     /* mmap(MAP_HUGETLB) from the reserved pool */
+#ifndef MATRIX_HUGE_PAGES
+#define MATRIX_HUGE_PAGES MATRIX_HUGE_PAGES_NONE
+#endif
+#define MATRIX_HUGE_PAGE_SIZE (2*1024*1024)
+/* blocks at least this large are zeroed (first touched) by all threads */
+#define MATRIX_PARALLEL_TOUCH_MIN_BYTES (1024*1024)
+
+/* random numbers are drawn in chunks of at most this many (VSL counts are int) */
+#define RANDOM_CHUNK_SIZE (1<<30)
+
+/* test matrices Omega for the range sketch Y = M*Omega */
+#define SKETCH_GAUSSIAN 0
+#define SKETCH_SRHT 1
+#define SKETCH_SPARSE_SIGN 2
+
+/* LAPACK drivers of the small core problems, set by core_solvers_configure: 
+ * singular_value_decomposition (and its in place version) uses gesvd, gesdd 
+ * (divide and conquer) or gesvj (one-sided Jacobi, m >= n, else gesdd); 
+ * compute_evals_and_evecs_of_symm_matrix uses syev, syevd (divide and conquer) 
+ * or syevr (MRRR, which also computes just the top eigenpairs) */
+#define SVD_SOLVER_GESVD 0
+#define SVD_SOLVER_GESDD 1
+#define SVD_SOLVER_JACOBI 2
+#define EIG_SOLVER_SYEV 0
+#define EIG_SOLVER_SYEVD 1
+#define EIG_SOLVER_SYEVR 2
+
+/* orthonormalization of a tall basis (see orthonormalize): Householder QR, 
+ * CholeskyQR2 (two passes of Gram matrix, Cholesky and triangular solve) or 
+ * shifted CholeskyQR3 (a first pass with a shifted Gram matrix, for panels too 
+ * ill-conditioned for CholeskyQR2); the Cholesky variants fall back to Householder 
+ * when a Cholesky factorization fails */
+#define ORTH_HOUSEHOLDER 0
+#define ORTH_CHOLESKY_QR2 1
+#define ORTH_SHIFTED_CHOLESKY_QR3 2
+#define ORTH_BLOCK_GRAM_SCHMIDT 3
+
+/* block classical Gram-Schmidt (BCGS2, see orthonormalize_against_basis): blocks of 
+ * BCGS_BLOCK_COLUMNS columns, and a second projection pass whenever the first one 
+ * removes enough of the block that its norm drops below BCGS_REORTH_TOL times the 
+ * norm before (the "twice is enough" criterion) */
+#define BCGS_BLOCK_COLUMNS 64
+#define BCGS_REORTH_TOL 0.70710678118654752
+
+/* nonzeros per row of the sparse sign test matrix, set with -DSPARSE_SIGN_NNZ_PER_ROW=.. */
+#ifndef SPARSE_SIGN_NNZ_PER_ROW
+#define SPARSE_SIGN_NNZ_PER_ROW 8
+#endif
+
+/* rows of M transformed together by the SRHT kernel */
+#define SRHT_BLOCK_ROWS 64
+
+/* rows of M (and of the product) handled together by the dense times sparse kernel */
+#define SPARSE_MULT_BLOCK_ROWS 64
+
+/* rows of A handled together by matrix_matrix_mult_in_place */
+#define IN_PLACE_BLOCK_ROWS 1024
+
+/* the QR factorizations of an mxn M switch to TSQR when its rows split into at 
+ * least two blocks of TSQR_MIN_BLOCK_ROWS_PER_COLUMN*n rows (one block per thread); 
+ * Q is rebuilt TSQR_APPLY_BLOCK_ROWS rows at a time */
+#define TSQR_MIN_BLOCK_ROWS_PER_COLUMN 8
+#define TSQR_APPLY_BLOCK_ROWS 256
+
+/* quantized storage of M: signed 8 or 16 bit values with one float scale per 
+ * block of QUANTIZE_BLOCK_ROWS rows of a column; the quantized products dequantize 
+ * tiles of QUANTIZE_TILE_ROWS x QUANTIZE_TILE_COLS entries (a multiple of the 
+ * block rows, sized to stay in L2) and hand them to gemm */
+#define QUANTIZE_BLOCK_ROWS 64
+#define QUANTIZE_TILE_ROWS 256
+#define QUANTIZE_TILE_COLS 64
+
+/* columns of M per panel in get_svd_residual_frobenius_norm; below a squared 
+ * relative residual of RESIDUAL_CANCELLATION_TOL the trace identity has lost 
+ * too many digits and the residual is summed explicitly instead */
+#define RESIDUAL_PANEL_COLUMNS 256
+#define RESIDUAL_CANCELLATION_TOL 1e-6
+
+/* self describing binary matrix format: a 64 byte header followed by the 
+ * payload at data_offset (a multiple of 64); little endian */
+#define MATRIX_FILE_MAGIC "RSVDMAT"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_HEADER_SIZE 64
+#define MATRIX_FILE_LEGACY_HEADER_SIZE (2*sizeof(int))
+#define MATRIX_FILE_DTYPE_FLOAT64 1
+#define MATRIX_FILE_DTYPE_FLOAT32 2
+#define MATRIX_FILE_ROW_MAJOR 0
+#define MATRIX_FILE_COL_MAJOR 1
+
 #define min(x,y) (((x) < (y)) ? (x) : (y))
 #define max(x,y) (((x) > (y)) ? (x) : (y))
 
 
+/* sparse matrix in compressed sparse row (CSR) format: the nonzeros of row i 
+ * are d[row_ptr[i]..row_ptr[i+1]-1] in columns col_ind[row_ptr[i]..row_ptr[i+1]-1]; 
+ * the CSR form of A^T is the compressed sparse column (CSC) form of A */
 typedef struct {
     int nrows, ncols;
-    double * d;
+    int64_t nnz;
+    int64_t * row_ptr;
+    int * col_ind;
+    real_t * d;
+} spmat;
+
+
+/* dense column major matrix, or a sparse one when sp is set: then d is NULL 
+ * and the products with it (matrix_matrix_mult, matrix_transpose_matrix_mult, 
+ * matrix_vector_mult, matrix_transpose_vector_mult) use sp and its transpose spt */
+typedef struct {
+    int nrows, ncols;
+    real_t * d;
+    char * mapping; /* file mapping that d points into, NULL if d is allocated */
+    size_t mapping_length;
+    spmat * sp;     /* M in CSR, NULL for a dense matrix */
+    spmat * spt;    /* M^T in CSR, i.e. M in CSC */
 } mat;
 
 
 typedef struct {
     int nrows;
-    double * d;
+    real_t * d;
 } vec;
 
 
+/* dense column major single precision matrix, used as a float32 shadow of M 
+ * by the mixed precision range finder */
+typedef struct {
+    int nrows, ncols;
+    float * d;
+} mat_float;
+
+
+/* dense column major matrix stored as 8 or 16 bit integers, entry (i,j) is 
+ * scales[j*num_row_blocks + i/QUANTIZE_BLOCK_ROWS] * q[j*nrows + i] */
+typedef struct {
+    int nrows, ncols;
+    int bits;               /* 8 (int8_t values) or 16 (int16_t values) */
+    int num_row_blocks;
+    void * q;
+    float * scales;
+} mat_quantized;
+
+
+/* allocation statistics of matrix_data_alloc (bytes are the requested sizes) */
+typedef struct {
+    size_t num_allocs, num_frees;
+    size_t bytes_allocated, bytes_in_use, peak_bytes_in_use;
+    size_t num_huge_page_allocs, num_huge_page_fallbacks;
+} matrix_alloc_stats;
+
+
+typedef struct {
+    char magic[8];          /* MATRIX_FILE_MAGIC */
+    int32_t version;        /* 0 for legacy files */
+    int32_t dtype;          /* MATRIX_FILE_DTYPE_* */
+    int32_t storage_order;  /* MATRIX_FILE_ROW_MAJOR or MATRIX_FILE_COL_MAJOR */
+    int32_t reserved;
+    int64_t nrows, ncols;
+    int64_t data_offset;    /* byte offset of the payload from start of file */
+    char padding[16];
+} matrix_file_header;
+
+
+/* sequential reader of a binary matrix file in panels: blocks of panel_size 
+ * rows for row major files, blocks of panel_size columns for column major files */
+typedef struct {
+    FILE *fp;
+    matrix_file_header header;
+    int panel_size;
+    int position;   /* rows (or columns) read since the start of the payload */
+    real_t *buffer;
+    void *raw;      /* panel as read when the file dtype is not real_t, else NULL */
+} matrix_file_stream;
+
+
+
+/* set the alignment and huge page mode (MATRIX_HUGE_PAGES_*) for later allocations */
+void matrix_alloc_configure(size_t alignment, int huge_pages);
+
+/* set the LAPACK drivers (SVD_SOLVER_*, EIG_SOLVER_*) of the small SVDs and 
+ * symmetric eigendecompositions; the defaults are gesvd and syev, which the 
+ * _with_work versions (and so rsvd_plan_execute) always use */
+void core_solvers_configure(int svd_solver, int eig_solver);
+
+/* allocate count entries, set to zero by parallel first touch for large blocks; 
+ * explicit huge pages fall back to transparent ones when the pool is exhausted */
+real_t * matrix_data_alloc(size_t count);
+
+void matrix_data_free(void *d);
+
+/* resize data from matrix_data_alloc to count entries, keeping the leading entries */
+real_t * matrix_data_realloc(real_t *d, size_t count);
+
+/* number of entries allocated for data from matrix_data_alloc (0 for NULL) */
+size_t matrix_data_capacity(real_t *d);
+
+matrix_alloc_stats matrix_alloc_get_stats();
+
+void matrix_alloc_print_stats();
+
+/* restart peak_bytes_in_use from the current bytes_in_use */
+void matrix_alloc_reset_peak();
+
 
 /* initialize new matrix and set all entries to zero */
 mat * matrix_new(int nrows, int ncols);
@@ -34,6 +297,15 @@ void matrix_delete(mat *M);
 
 void vector_delete(vec *v);
 
+/* initialize new nrows x ncols sparse matrix with room for nnz nonzeros */
+spmat * spmat_new(int nrows, int ncols, int64_t nnz);
+
+void spmat_delete(spmat *A);
+
+/* wrap the sparse A (which is then owned by the returned matrix) as a mat, 
+ * building its CSC form so that both M*X and M^T*X are row parallel */
+mat * matrix_new_from_sparse(spmat *A);
+
 
 /* set element in column major format */
 void matrix_set_element(mat *M, int row_num, int col_num, double val);
@@ -49,11 +321,85 @@ void vector_set_element(vec *v, int row_num, double val);
 /* get vector element */
 double vector_get_element(vec *v, int row_num);
 
-/* load matrix from binary file */
+/* load matrix from binary file in either the legacy or the self describing format 
+(memory mapped, reports load bandwidth); column major files in the working 
+precision are used as M->d directly without a copy, float64 and float32 
+payloads are otherwise converted */
 mat * matrix_load_from_binary_file(char *fname);
 
 
-void vector_set_data(vec *v, double *data);
+/* load a sparse matrix in CSR from a MatrixMarket coordinate file (real, integer 
+ * or pattern; general or symmetric), streaming the entries without a dense copy; 
+ * files without the %%MatrixMarket banner are read as in matrix_load_from_text_file 
+ * of the other backends: one comment line, "nrows ncols nnz", then 0-based triples */
+spmat * spmat_load_from_matrix_market_file(char *fname);
+
+
+/* At = A^T in CSR, i.e. A in CSC, by a counting sort over the columns */
+spmat * spmat_transpose(spmat *A);
+
+
+/* fill in header from the first bytes of a binary matrix file (legacy or new format);
+returns 0 on success */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header);
+
+
+/* read header of a binary matrix file from the current position of fp, 
+without seeking, so pipes work too; returns 0 on success */
+int matrix_read_binary_file_header(FILE *fp, matrix_file_header *header);
+
+
+/* write header of the self describing format for a payload of MATRIX_FILE_DTYPE_* dtype */
+void matrix_write_binary_file_header(FILE *fp, int64_t nrows, int64_t ncols, int dtype, int storage_order);
+
+
+/* write M to binary file in the self describing format with given storage order 
+ * (the payload is in the working precision, MATRIX_FILE_DTYPE_NATIVE) */
+void matrix_write_to_binary_file(mat *M, char *fname, int storage_order);
+
+
+/* convert legacy binary matrix file to the self describing format; 
+returns 0 on success */
+int matrix_convert_legacy_binary_file(char *legacy_fname, char *fname, int storage_order);
+
+
+/* open binary matrix file for streaming in panels, "-" reads from stdin; 
+returns NULL on failure */
+matrix_file_stream * matrix_file_stream_open(char *fname, int panel_size);
+
+
+void matrix_file_stream_close(matrix_file_stream *S);
+
+
+/* move the stream back to the first panel (needs a seekable file) */
+void matrix_file_stream_rewind(matrix_file_stream *S);
+
+
+/* read the next panel of the stream into P (P->d points into the stream buffer);
+ * for row major files P = M(offset:offset+r-1,:)^T is n x r, 
+ * for column major files P = M(:,offset:offset+c-1) is m x c;
+ * returns 0 when there are no more panels */
+int matrix_file_stream_next_panel(matrix_file_stream *S, mat *P, int *offset);
+
+
+/* Y = M*X in one sequential pass over the file */
+void matrix_file_stream_mult(matrix_file_stream *S, mat *X, mat *Y);
+
+
+/* Y = M^T*X in one sequential pass over the file */
+void matrix_file_stream_transpose_mult(matrix_file_stream *S, mat *X, mat *Y);
+
+
+/* Y = M*X and W = M^T*Z in one sequential pass over the remaining panels 
+ * of the stream; does not seek, so it works on pipes */
+void matrix_file_stream_two_sided_mult(matrix_file_stream *S, mat *X, mat *Y, mat *Z, mat *W);
+
+
+/* fill column major M from row major data with a cache blocked parallel transpose */
+void matrix_set_from_row_major_data(mat *M, real_t *data);
+
+
+void vector_set_data(vec *v, real_t *data);
 
 
 /* scale vector by a constant */
@@ -92,6 +438,10 @@ void vector_sub(vec *a, vec *b);
 void matrix_sub(mat *A, mat *B);
 
 
+/* add B to A and save result in A  */
+void matrix_add(mat *A, mat *B);
+
+
 /* matrix frobenius norm */
 double get_matrix_frobenius_norm(mat *M);
 
@@ -110,7 +460,80 @@ void vector_print(vec * v);
 void initialize_random_matrix(mat *M);
 
 
-/* C = A*B ; column major */
+/* single precision matrices (data from matrix_data_alloc, zeroed) */
+mat_float * matrix_float_new(int nrows, int ncols);
+
+void matrix_float_delete(mat_float *F);
+
+/* F = M rounded to single precision, and back */
+void matrix_float_from_double(mat_float *F, mat *M);
+
+void matrix_double_from_float(mat *M, mat_float *F);
+
+/* Gaussian entries generated in single precision */
+void initialize_random_matrix_float(mat_float *F);
+
+/* C = A*B and C = A^T*B with sgemm; use the first C->ncols columns of B */
+void matrix_float_matrix_mult(mat_float *A, mat_float *B, mat_float *C);
+
+void matrix_float_transpose_matrix_mult(mat_float *A, mat_float *B, mat_float *C);
+
+
+/* quantize the dense M to bits = 8 or 16 bits per entry, rounding to nearest 
+ * with the scale of each block set by its largest magnitude */
+mat_quantized * matrix_quantized_new_from_matrix(mat *M, int bits);
+
+void matrix_quantized_delete(mat_quantized *Mq);
+
+/* bytes of values and scales held by Mq */
+size_t matrix_quantized_bytes(mat_quantized *Mq);
+
+/* norm(M - Mq)_F / norm(M)_F */
+double matrix_quantized_relative_error(mat_quantized *Mq, mat *M);
+
+/* Y = Mq*X and Y = Mq^T*X using the first Y->ncols columns of X; the threads own 
+ * disjoint row blocks of Y and each dequantizes one tile of Mq at a time, so 
+ * M is read at 1 or 2 bytes per entry and never expanded */
+void matrix_quantized_matrix_mult(mat_quantized *Mq, mat *X, mat *Y);
+
+void matrix_quantized_transpose_matrix_mult(mat_quantized *Mq, mat *X, mat *Y);
+
+
+/* Y = M*Omega for the random test matrix Omega (n x Y->ncols) of the given 
+ * sketch_type: SKETCH_GAUSSIAN forms a dense Gaussian Omega and multiplies, 
+ * SKETCH_SRHT applies a subsampled randomized Hadamard transform to the rows of M, 
+ * SKETCH_SPARSE_SIGN uses a sparse sign Omega with SPARSE_SIGN_NNZ_PER_ROW nonzeros per row */
+void matrix_random_sketch_mult(mat *M, mat *Y, int sketch_type);
+
+
+/* Y = M*Omega with Omega = sqrt(N/l) D H P the subsampled randomized Hadamard 
+ * transform: D is n x n diagonal with random signs, H the N x N normalized 
+ * Walsh-Hadamard matrix (N the next power of two >= n, M zero padded) and P 
+ * picks l = Y->ncols of its columns at random; Omega is never formed, the rows 
+ * of M are transformed in blocks of SRHT_BLOCK_ROWS with a fast Walsh-Hadamard 
+ * transform in O(m N log N) work */
+void matrix_srht_sketch_mult(mat *M, mat *Y);
+
+
+/* fill the CSR matrix RN (nnz = nrows*zeta, zeta <= ncols) with a sparse sign 
+ * test matrix: each row has zeta nonzeros +-1/sqrt(zeta) in distinct random columns */
+void initialize_sparse_sign_matrix(spmat *RN, int zeta);
+
+
+/* Y = A*X for sparse A (CSR) and dense X (column major), using the first Y->ncols 
+ * columns of X; X and Y are transposed to row major around the kernel so that each 
+ * row of A, handled by one thread, reads and updates contiguous rows; O(nnz(A)*l) */
+void spmat_matrix_mult(spmat *A, mat *X, mat *Y);
+
+
+/* C = M*A for dense M (column major) and sparse A (CSR); M is read once, in 
+ * blocks of SPARSE_MULT_BLOCK_ROWS rows, each block of C accumulating 
+ * M(:,j)*A(j,:) over the columns j of M, in O(m*nnz(A)) work */
+void matrix_sparse_matrix_mult(mat *M, spmat *A, mat *C);
+
+
+/* C = A*B ; column major 
+ * only the first C->ncols columns of B are used, so products can be truncated without copies */
 void matrix_matrix_mult(mat *A, mat *B, mat *C);
 
 
@@ -118,10 +541,27 @@ void matrix_matrix_mult(mat *A, mat *B, mat *C);
 void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C);
 
 
-/* C = A*B^T ; column major */
+/* C = A*B^T ; column major 
+ * only the first C->ncols rows of B are used, so products can be truncated without copies */
 void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C);
 
 
+/* C(row_offset:row_offset+A->ncols-1,:) = A^T*B ; column major */
+void matrix_transpose_matrix_mult_into_rows(mat *A, mat *B, mat *C, int row_offset);
+
+
+/* C = C + A*B(row_offset:row_offset+A->ncols-1,:) ; column major */
+void matrix_matrix_mult_from_rows_add(mat *A, mat *B, int row_offset, mat *C);
+
+
+/* B = B*R^{-1} (B*R^{-T} if transpose is nonzero) with R upper triangular ; column major */
+void matrix_upper_triangular_right_solve(mat *R, mat *B, int transpose);
+
+
+/* C = C - A*B ; column major */
+void matrix_matrix_mult_sub(mat *A, mat *B, mat *C);
+
+
 /* y = M*x ; column major */
 void matrix_vector_mult(mat *M, vec *x, vec *y);
 
@@ -183,21 +623,24 @@ p = (dot(v,u)/norm(u)^2)*u;
 void project_vector(vec *v, vec *u, vec *p);
 
 
-/* build orthonormal basis matrix
-Q = Y;
-for j=1:k
-    vj = Q(:,j);
-    for i=1:(j-1)
-        vi = Q(:,i);
-        vj = vj - project_vec(vj,vi);
-    end
-    vj = vj/norm(vj);
-    Q(:,j) = vj;
-end
-*/
+/* build orthonormal basis matrix Q of the range of A by block Gram-Schmidt 
+ * (orthonormalize with ORTH_BLOCK_GRAM_SCHMIDT): BCGS_BLOCK_COLUMNS columns at a 
+ * time are orthogonalized against the previous ones with gemm and among 
+ * themselves with CholeskyQR2, instead of one column at a time */
 void build_orthonormal_basis_from_mat(mat *A, mat *Q);
 
 
+/* A(:,1:k) = A*B(:,1:k), or A*B(1:k,:)^T if transpose, one block of 
+ * IN_PLACE_BLOCK_ROWS rows at a time so that no second mxk matrix is needed; 
+ * A keeps its storage and A->ncols becomes k */
+void matrix_matrix_mult_in_place(mat *A, mat *B, int k, int transpose);
+
+
+/* set V to a view of columns j0..j0+ncols-1 of M sharing its storage (no copy); 
+ * V is declared on the stack by the caller and is not deleted */
+void matrix_columns_view(mat *V, mat *M, int j0, int ncols);
+
+
 void matrix_copy_first_rows(mat *M_out, mat *M);
 
 
@@ -231,11 +674,17 @@ void fill_matrix_from_row_list(mat *M, vec *I, mat *M_k);
 
 void append_matrices_horizontally(mat *A, mat *B, mat *C);
 
+
+/* A = [A, B] in place: the storage of A (from matrix_data_alloc) is extended by 
+ * B->ncols columns, at least doubling when it is full, so that building A one block 
+ * at a time copies O(final size) entries overall; A->ncols counts the columns in use */
+void matrix_append_columns(mat *A, mat *B);
+
  
 void append_matrices_vertically(mat *A, mat *B, mat *C);
 
 
-/* calculate percent error between A and B: 100*norm(A - B)/norm(A) */
+/* calculate percent error between A and B: 100*norm(A - B)/norm(A); either may be sparse */
 double get_percent_error_between_two_mats(mat *A, mat *B);
 
 
@@ -253,6 +702,11 @@ void compute_matrix_column_norms(mat *M, vec *column_norms);
 */
 void compute_evals_and_evecs_of_symm_matrix(mat *S, vec *evals);
 
+/* top num eigenpairs of the symmetric nxn S, laid out as by the full 
+ * eigendecomposition (ascending, in the last num entries of evals and columns 
+ * of S; the rest is zeroed); only EIG_SOLVER_SYEVR saves work for num < n */
+void compute_top_evals_and_evecs_of_symm_matrix(mat *S, vec *evals, int num);
+
 
 /* Performs [Q,R] = qr(M,'0') compact QR factorization 
 M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
@@ -263,6 +717,106 @@ void compact_QR_factorization(mat *M, mat *Q, mat *R);
 M is mxn ; Q is mxn ; R is not computed */ 
 void QR_factorization_getQ(mat *M, mat *Q);
 
+
+/* in place versions: M (mxn, m >= n) is overwritten by Q */
+void QR_factorization_getQ_in_place(mat *M);
+
+void compact_QR_factorization_in_place(mat *M, mat *R);
+
+
+/* [Q,R] = qr(M,'0') with Q kept implicit: M (mxn, m >= n) is overwritten by the 
+ * Householder reflectors (geqrf, no orgqr pass and no mxn Q) with their scalars 
+ * in tau (n entries); R is nxn */
+void compact_QR_factorization_implicit(mat *M, vec *tau, mat *R);
+
+/* C = Q*X with Q (mxn) from compact_QR_factorization_implicit in QR and tau, 
+ * using the first n rows and C->ncols columns of X; the reflectors are applied 
+ * blocked (compact WY) by ormqr */
+void implicit_Q_matrix_mult(mat *QR, vec *tau, mat *X, mat *C);
+
+
+/* Q = orthonormal basis of the range of M (mxn, m >= n) with orth_type one of 
+ * ORTH_HOUSEHOLDER, ORTH_CHOLESKY_QR2, ORTH_SHIFTED_CHOLESKY_QR3 or ORTH_BLOCK_GRAM_SCHMIDT; 
+ * the Cholesky variants cost one syrk, an nxn Cholesky and one trsm per pass */
+void orthonormalize(mat *M, mat *Q, int orth_type);
+
+/* as orthonormalize with Q overwriting M */
+void orthonormalize_in_place(mat *M, int orth_type);
+
+/* BCGS2 step for incremental bases: Y (mxb) is overwritten by an orthonormal basis 
+ * of the part of its range orthogonal to the orthonormal columns of Q (mxk; Q may be 
+ * NULL or have no columns): Y = Y - Q*(Q^T*Y) by gemm, reorthogonalized once more 
+ * if that cancelled too much, with the block itself orthonormalized by orth_type 
+ * (ORTH_HOUSEHOLDER, ORTH_CHOLESKY_QR2 or ORTH_SHIFTED_CHOLESKY_QR3) after each pass */
+void orthonormalize_against_basis(mat *Q, mat *Y, int orth_type);
+
+
+/* tall skinny QR (TSQR) of M (mxn, m >> n) with Q overwriting M and R (nxn, may be 
+ * NULL): the row blocks are factored in parallel, their R factors reduced pairwise 
+ * in a binary tree and Q rebuilt in parallel; the four QR functions above use it 
+ * when tall_skinny_QR_num_blocks(m,n) > 1 */
+void tall_skinny_QR_factorization_in_place(mat *M, mat *R);
+
+int tall_skinny_QR_num_blocks(int m, int n);
+
+
+/* M = U*diag(svals)*Vt with U overwriting M (mxn, m >= n), using the svd_solver 
+ * of core_solvers_configure */
+void singular_value_decomposition_in_place(mat *M, vec *svals, mat *Vt);
+
+/* computes SVD: M = U*S*Vt; note Vt = V^T */
+void singular_value_decomposition(mat *M, mat *U, mat *S, mat *Vt);
+
+
+/* LAPACK workspace sizes (in entries) for the _with_work versions below, 
+ * which allocate nothing and can be called repeatedly on the same buffers; 
+ * they always use gesvd and syev, not the drivers of core_solvers_configure */
+int QR_factorization_workspace_size(int m, int n);
+
+int singular_value_decomposition_workspace_size(int m, int n);
+
+int symmetric_eigendecomposition_workspace_size(int n);
+
+
+/* as QR_factorization_getQ; tau has min(m,n) entries */
+void QR_factorization_getQ_with_work(mat *M, mat *Q, vec *tau, real_t *work, int lwork);
+
+
+/* as compact_QR_factorization; tau has min(m,n) entries */
+void compact_QR_factorization_with_work(mat *M, mat *Q, mat *R, vec *tau, real_t *work, int lwork);
+
+
+/* M = U*diag(svals)*Vt, M is overwritten */
+void singular_value_decomposition_with_work(mat *M, mat *U, vec *svals, mat *Vt, real_t *work, int lwork);
+
+
+void compute_evals_and_evecs_of_symm_matrix_with_work(mat *S, vec *evals, real_t *work, int lwork);
+
+
 /* P = U * S * Vt */
 void form_svd_product_matrix(mat *U, mat *S, mat *V, mat *P);
 
+
+/* norm(M - U*S*V^T)_F without forming the mxn product: from panels of M via 
+ * norm(M)^2 - 2 tr(S^T U^T M V) + norm(U S V^T)^2, where the last term comes 
+ * from the kxk Gram matrices of U and V; falls back to summing the residual 
+ * panels explicitly (compensated) when the identity cancels. Works for sparse 
+ * M and allocates at most one mx256 panel plus a few kxk matrices */
+double get_svd_residual_frobenius_norm(mat *M, mat *U, mat *S, mat *V);
+
+
+/* 100*norm(M - U*S*V^T)/norm(M), as get_percent_error_between_two_mats 
+ * applied to P from form_svd_product_matrix */
+double get_percent_error_of_svd(mat *M, mat *U, mat *S, mat *V);
+
+
+/* a posteriori estimates of the error E = M - U*S*V^T from r Gaussian probes w_i, 
+ * at the cost of M*W plus O((m+n)kr) instead of a full residual: 
+ * spectral_bound = 10 sqrt(2/pi) max_i norm(E w_i) >= norm(E)_2 with probability 
+ * at least 1 - 10^(-r) (Halko, Martinsson, Tropp, lemma 4.1); 
+ * frobenius_estimate = sqrt(mean_i norm(E w_i)^2) has expectation norm(E)_F^2 
+ * when squared, and frobenius_bound = frobenius_estimate/sqrt(x) >= norm(E)_F with 
+ * probability at least 1 - delta, where (x e^(1-x))^(r/2) = delta is the Chernoff 
+ * bound of the lower tail (attained for rank one E) */
+void estimate_svd_error(mat *M, mat *U, mat *S, mat *V, int r, double delta, double *spectral_bound, double *frobenius_estimate, double *frobenius_bound);
+
@@ -0,0 +1,145 @@
+/* checks the 64-bit element counts and offsets on matrices with more than 2^31 entries:
+ * M is m x m with one nonzero per row, M(i,c(i)) with c(i) = 7919*i mod m a permutation,
+ * so its singular values are the magnitudes of the nonzeros; the last TEST_RANK rows hold
+ * 1000/(1+t), t = 0..TEST_RANK-1 (most of them at offsets c(i)*m + i beyond 2^31), the
+ * other rows at most 1e-3, so the best rank TEST_RANK residual is the norm of those.
+ * A 60000 x 60000 sparse M (3.6e9 entries, 60000 nonzeros) goes through spmat_transpose,
+ * the sparse products, svd2, svd3 and the panel scatter of the residual; the same kind of
+ * M stored dense (46341 x 46341, 17 GB in double) is skipped when it can not be allocated
+ * usage: ./test_large_matrix_mkl ; returns the number of failed checks
+ */
+
+#include "low_rank_svd_algorithms_intel_mkl.h"
+
+#define TEST_RANK 10
+#define TEST_OVERSAMPLING 10
+#define TEST_SPARSE_SIZE 60000
+#define TEST_DENSE_SIZE 46341
+
+
+/* column of the nonzero of row i */
+static int test_column(int i, int m){
+    return (int)((7919*(int64_t)i) % m);
+}
+
+
+/* the nonzero of row i */
+static double test_value(int i, int m){
+    if(i >= m - TEST_RANK){
+        return 1000.0/(1 + (m - 1 - i));
+    }
+    return 1e-3*(1 + i%7)/7.0;
+}
+
+
+/* norm of the rows below the top TEST_RANK */
+static double test_tail_norm(int m){
+    int i;
+    double val, sum = 0;
+    for(i=0; i<m-TEST_RANK; i++){
+        val = test_value(i,m);
+        sum += val*val;
+    }
+    return sqrt(sum);
+}
+
+
+/* compare S with the known singular values (to relative sigma_tol) and the residual 
+ * with the best one (at most residual_factor times larger); without power iterations 
+ * svd2 is only accurate to the tail over the gap and its residual to a small factor */
+static int check_svd(char *name, mat *M, mat *U, mat *S, mat *V, double sigma_tol, double residual_factor){
+    int t, failures = 0;
+    double sigma, err, max_err = 0, residual, tail;
+    for(t=0; t<TEST_RANK; t++){
+        sigma = 1000.0/(1 + t);
+        err = fabs(matrix_get_element(S,t,t) - sigma)/sigma;
+        max_err = max(max_err, err);
+    }
+    if(max_err > sigma_tol){
+        failures++;
+    }
+    residual = get_svd_residual_frobenius_norm(M,U,S,V);
+    tail = test_tail_norm(M->nrows);
+    if(residual < (1 - 1e-2)*tail || residual > residual_factor*tail){
+        failures++;
+    }
+    printf("%s %s: max relative error of the top %d singular values %e, residual %e (best %e)\n",
+        failures ? "FAIL" : "PASS", name, TEST_RANK, max_err, residual, tail);
+    return failures;
+}
+
+
+static int test_sparse(){
+    int i, m, failures = 0;
+    int64_t t;
+    mat *M, *U, *S, *V;
+    m = TEST_SPARSE_SIZE;
+
+    spmat *A = spmat_new(m, m, m);
+    for(i=0; i<m; i++){
+        A->row_ptr[i] = i;
+        A->col_ind[i] = test_column(i,m);
+        A->d[i] = test_value(i,m);
+    }
+    A->row_ptr[m] = m;
+    M = matrix_new_from_sparse(A);
+    printf("sparse M is %d x %d with %" PRId64 " entries and %" PRId64 " nonzeros\n",
+        m, m, ((int64_t)m)*m, M->sp->nnz);
+
+    // the CSC copy holds row i at column c(i)
+    for(i=0; i<m; i++){
+        t = M->spt->row_ptr[test_column(i,m)];
+        if(M->spt->row_ptr[test_column(i,m)+1] - t != 1 || M->spt->col_ind[t] != i){
+            failures++;
+            break;
+        }
+    }
+    printf("%s spmat_transpose\n", failures ? "FAIL" : "PASS");
+
+    randomized_low_rank_svd2(M, TEST_RANK, TEST_OVERSAMPLING, SKETCH_GAUSSIAN, &U, &S, &V);
+    failures += check_svd("sparse svd2", M, U, S, V, 1e-4, 3.0);
+    matrix_delete(U); matrix_delete(S); matrix_delete(V);
+
+    randomized_low_rank_svd3(M, TEST_RANK, TEST_OVERSAMPLING, 1, SKETCH_GAUSSIAN, &U, &S, &V);
+    failures += check_svd("sparse svd3", M, U, S, V, sqrt(REAL_EPSILON), 1.01);
+    matrix_delete(U); matrix_delete(S); matrix_delete(V);
+
+    matrix_delete(M);
+    return failures;
+}
+
+
+static int test_dense(){
+    int i, m, failures = 0;
+    mat *M, *U, *S, *V;
+    m = TEST_DENSE_SIZE;
+
+    M = matrix_new(m, m);
+    if(M->d == NULL){
+        printf("SKIP dense %d x %d M (%.1f GB) could not be allocated\n",
+            m, m, ((double)m)*m*sizeof(real_t)/1.0e9);
+        matrix_delete(M);
+        return 0;
+    }
+    for(i=0; i<m; i++){
+        matrix_set_element(M, i, test_column(i,m), test_value(i,m));
+    }
+
+    randomized_low_rank_svd3(M, TEST_RANK, TEST_OVERSAMPLING, 1, SKETCH_GAUSSIAN, &U, &S, &V);
+    failures += check_svd("dense svd3", M, U, S, V, sqrt(REAL_EPSILON), 1.01);
+    matrix_delete(U); matrix_delete(S); matrix_delete(V);
+
+    matrix_delete(M);
+    return failures;
+}
+
+
+int main()
+{
+    int failures = 0;
+    printf("working precision: %s\n", RSVD_PRECISION_NAME);
+    failures += test_sparse();
+    failures += test_dense();
+    printf("%d failed checks\n", failures);
+    return failures;
+}
@@ -5,7 +5,7 @@
 
 
 int main(int argc, char** argv){
-    int i, j, m, n, k, culaVersion;
+    int i, j, m, n, k, p, culaVersion;
     double normM,normU,normS,normV,normP,percent_error;
     mat *M, *U, *S, *V, *P;
     time_t start_time, end_time;
@@ -29,15 +29,16 @@ int main(int argc, char** argv){
 
     // now test low rank SVD of M..
     k = 1000;
+    p = 20;
     U = matrix_new(m,k);
     S = matrix_new(k,k);
     V = matrix_new(n,k);
     
-    printf("calling random SVD with k = %d\n", k);
+    printf("calling random SVD with k = %d and oversampling p = %d\n", k, p);
     time(&start_time);
-    //randomized_low_rank_svd1(M, k, U, S, V);
-    //randomized_low_rank_svd2(M, k, U, S, V);
-    randomized_low_rank_svd3(M, k, 20, U, S, V);
+    //randomized_low_rank_svd1(M, k, p, U, S, V);
+    //randomized_low_rank_svd2(M, k, p, U, S, V);
+    randomized_low_rank_svd3(M, k, p, 20, U, S, V);
     time(&end_time);
     printf("elapsed time: about %d seconds\n", (int)difftime(end_time,start_time));
 
@@ -1,67 +1,74 @@
 #include "low_rank_svd_algorithms_nvidia_cula.h"
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(mat *M, int k, mat *U, mat *S, mat *V){
-    int i,j,m,n;
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd1(mat *M, int k, int p, mat *U, mat *S, mat *V){
+    int i,j,m,n,l;
     double val;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // build random matrix
-    mat *RN = matrix_new(n, k);
+    mat *RN = matrix_new(n, l);
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
+    mat *Y = matrix_new(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q..\n");
-    mat *Q = matrix_new(m,k);
+    mat *Q = matrix_new(m,l);
     //build_orthonormal_basis_from_mat(Y,Q);
     QR_factorization_getQ(Y, Q);
 
 
     // build the matrix B B^T = Q^T M M^T Q column by column 
-    // Bt = M^T Q ; nxm * mxk = nxk
+    // Bt = M^T Q ; nxm * mxl = nxl
     printf("form BBt..\n");
-    mat *B = matrix_new(k,n);
+    mat *B = matrix_new(l,n);
     matrix_transpose_matrix_mult(Q,M,B);
 
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);    
 
-    mat *BBt = matrix_new(k,k);
+    mat *BBt = matrix_new(l,l);
     matrix_matrix_mult(B,Bt,BBt);    
 
     // compute eigendecomposition of BBt
     printf("eigendecompose BBt..\n");
-    vec *evals = vector_new(k);
-    mat *Uhat = matrix_new(k, k);
+    vec *evals = vector_new(l);
+    mat *Uhat = matrix_new(l, l);
     matrix_copy_symmetric(Uhat,BBt);
     compute_evals_and_evecs_of_symm_matrix(Uhat, evals);
 
+    // eigenvalues are in ascending order, so the top k 
+    // eigenvectors are the last k columns of Uhat
+    mat Uhat_k;
+    matrix_columns_view(&Uhat_k, Uhat, l-k, k);
+
 
     // compute singular values and matrix Sigma
     printf("form S..\n");
     vec *singvals = vector_new(k);
     for(i=0; i<k; i++){
-        vector_set_element(singvals,i,sqrt(vector_get_element(evals,i)));
+        vector_set_element(singvals,i,sqrt(vector_get_element(evals,l-k+i)));
     }
     initialize_diagonal_matrix(S, singvals);
     
-    // compute U = Q*Uhat mxk * kxk = mxk  
+    // compute U = Q*Uhat_k mxl * lxk = mxk  
     printf("form U..\n");
-    matrix_matrix_mult(Q,Uhat,U);
+    matrix_matrix_mult(Q,&Uhat_k,U);
 
     // compute nxk V 
-    // V = B^T Uhat * Sigma^{-1}
+    // V = B^T Uhat_k * Sigma^{-1}
     printf("form V..\n");
     mat *Sinv = matrix_new(k,k);
-    mat *UhatSinv = matrix_new(k,k);
+    mat *UhatSinv = matrix_new(l,k);
     invert_diagonal_matrix(Sinv,S);
-    matrix_matrix_mult(Uhat,Sinv,UhatSinv);
+    matrix_matrix_mult(&Uhat_k,Sinv,UhatSinv);
     matrix_matrix_mult(Bt,UhatSinv,V);
 
     // clean up
@@ -76,51 +83,53 @@ void randomized_low_rank_svd1(mat *M, int k, mat *U, mat *S, mat *V){
 
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR version */
-void randomized_low_rank_svd2(mat *M, int k, mat *U, mat *S, mat *V){
-    int i,j,m,n;
+/* computes the approximate low rank SVD of rank k of matrix M using QR version 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd2(mat *M, int k, int p, mat *U, mat *S, mat *V){
+    int i,j,m,n,l;
     double val;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // build random matrix
-    mat *RN = matrix_new(n, k);
+    mat *RN = matrix_new(n, l);
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
+    mat *Y = matrix_new(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q..\n");
-    mat *Q = matrix_new(m,k);
+    mat *Q = matrix_new(m,l);
     //build_orthonormal_basis_from_mat(Y,Q);
     QR_factorization_getQ(Y, Q);
 
-    // form Bt = Mt*Q : nxm * mxk = nxk
+    // form Bt = Mt*Q : nxm * mxl = nxl
     printf("form Bt..\n");
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);
 
     // compute QR factorization of Bt    
     //M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
     //void compact_QR_factorization(mat *M, mat *Q, mat *R)
     printf("doing QR..\n");
-    mat *Qhat = matrix_new(n,k);
-    mat *Rhat = matrix_new(k,k);   
+    mat *Qhat = matrix_new(n,l);
+    mat *Rhat = matrix_new(l,l);   
     compact_QR_factorization(Bt,Qhat,Rhat);
 
-    // compute SVD of Rhat (kxk)
+    // compute SVD of Rhat (lxl), S keeps the top k singular values
     printf("doing SVD..\n");
-    mat *Uhat = matrix_new(k,k);
-    mat *Vhat_trans = matrix_new(k,k);
+    mat *Uhat = matrix_new(l,l);
+    mat *Vhat_trans = matrix_new(l,l);
     singular_value_decomposition(Rhat, Uhat, S, Vhat_trans);
 
-    // U = Q*Vhat_trans
+    // U = Q*Vhat_trans(1:k,:)^T
     printf("form U..\n");
     matrix_matrix_transpose_mult(Q,Vhat_trans,U);
 
-    // V = Qhat*Uhat
+    // V = Qhat*Uhat(:,1:k)
     printf("form V..\n");
     matrix_matrix_mult(Qhat,Uhat,V);
 
@@ -138,32 +147,34 @@ void randomized_low_rank_svd2(mat *M, int k, mat *U, mat *S, mat *V){
 
 
 /* computes the approximate low rank SVD of rank k of matrix M using QR version 
- * with range sampling via (M M^T)^q M R*/
-void randomized_low_rank_svd3(mat *M, int k, int q, mat *U, mat *S, mat *V){
-    int i,j,m,n;
+ * with range sampling via (M M^T)^q M R with k+p random samples 
+ * (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd3(mat *M, int k, int p, int q, mat *U, mat *S, mat *V){
+    int i,j,m,n,l;
     double val;
     m = M->nrows; n = M->ncols;
+    l = k + p;
 
     // build random matrix
-    mat *RN = matrix_new(n, k);
+    mat *RN = matrix_new(n, l);
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    mat *Y = matrix_new(m,k);
+    mat *Y = matrix_new(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q with q=%d..\n",q);
-    mat *Q = matrix_new(m,k);
+    mat *Q = matrix_new(m,l);
     //build_orthonormal_basis_from_mat(Y,Q);
     QR_factorization_getQ(Y, Q);
 
 
     // now refine Q
-    mat *Z = matrix_new(m,k);
-    Y = matrix_new(n,k);
-    mat *W = matrix_new(n,k);
+    mat *Z = matrix_new(m,l);
+    Y = matrix_new(n,l);
+    mat *W = matrix_new(n,l);
     for(j=0; j<q; j++){
         printf("in loop for j=%d of %d\n", j, q);
         printf("M is %d x %d and Q is %d x %d and Y is %d x %d\n", M->nrows, M->ncols, Q->nrows, Q->ncols, Y->nrows, Y->ncols);
@@ -190,30 +201,30 @@ void randomized_low_rank_svd3(mat *M, int k, int q, mat *U, mat *S, mat *V){
     QR_factorization_getQ(Z, Q);
 
 
-    // form Bt = Mt*Q : nxm * mxk = nxk
+    // form Bt = Mt*Q : nxm * mxl = nxl
     printf("form Bt..\n");
-    mat *Bt = matrix_new(n,k);
+    mat *Bt = matrix_new(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);
 
     // compute QR factorization of Bt    
     //M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
     //void compact_QR_factorization(mat *M, mat *Q, mat *R)
     printf("doing QR..\n");
-    mat *Qhat = matrix_new(n,k);
-    mat *Rhat = matrix_new(k,k);   
+    mat *Qhat = matrix_new(n,l);
+    mat *Rhat = matrix_new(l,l);   
     compact_QR_factorization(Bt,Qhat,Rhat);
 
-    // compute SVD of Rhat (kxk)
+    // compute SVD of Rhat (lxl), S keeps the top k singular values
     printf("doing SVD..\n");
-    mat *Uhat = matrix_new(k,k);
-    mat *Vhat_trans = matrix_new(k,k);
+    mat *Uhat = matrix_new(l,l);
+    mat *Vhat_trans = matrix_new(l,l);
     singular_value_decomposition(Rhat, Uhat, S, Vhat_trans);
 
-    // U = Q*Vhat_trans
+    // U = Q*Vhat_trans(1:k,:)^T
     printf("form U..\n");
     matrix_matrix_transpose_mult(Q,Vhat_trans,U);
 
-    // V = Qhat*Uhat
+    // V = Qhat*Uhat(:,1:k)
     printf("form V..\n");
     matrix_matrix_mult(Qhat,Uhat,V);
 
@@ -1,14 +1,17 @@
 #include "matrix_vector_functions_nvidia_cula.h"
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(mat *M, int k, mat *U, mat *S, mat *V);
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version; 
+ * the range is sampled with k+p random vectors (p is the oversampling, typically 
+ * 5 to 20) and the result is truncated to rank k */
+void randomized_low_rank_svd1(mat *M, int k, int p, mat *U, mat *S, mat *V);
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR version */
-void randomized_low_rank_svd2(mat *M, int k, mat *U, mat *S, mat *V);
+/* computes the approximate low rank SVD of rank k of matrix M using QR version 
+ * with k+p random samples truncated to rank k */
+void randomized_low_rank_svd2(mat *M, int k, int p, mat *U, mat *S, mat *V);
 
 
 /* computes the approximate low rank SVD of rank k of matrix M using QR version 
- * with range sampling via (M M^T)^q M R*/
-void randomized_low_rank_svd3(mat *M, int k, int q, mat *U, mat *S, mat *V);
+ * with range sampling via (M M^T)^q M R with k+p random samples truncated to rank k */
+void randomized_low_rank_svd3(mat *M, int k, int p, int q, mat *U, mat *S, mat *V);
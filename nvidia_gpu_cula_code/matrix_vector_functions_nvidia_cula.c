@@ -13,6 +13,8 @@ mat * matrix_new(int nrows, int ncols)
     M->d = (double*)calloc(nrows*ncols, sizeof(double));
     M->nrows = nrows;
     M->ncols = ncols;
+    M->mapping = NULL;
+    M->mapping_length = 0;
     return M;
 }
 
@@ -29,7 +31,12 @@ vec * vector_new(int nrows)
 
 void matrix_delete(mat *M)
 {
-    free(M->d);
+    if(M->mapping != NULL){
+        munmap(M->mapping, M->mapping_length);
+    }
+    else{
+        free(M->d);
+    }
     free(M);
 }
 
@@ -176,39 +183,158 @@ mat * matrix_load_from_text_file(char *fname){
 
 
 
+/* 0 if the header describes a nonempty payload of dtype_size byte entries that lies 
+ * within a file of file_size bytes, compared without overflow; -1 otherwise */
+static int matrix_file_check_payload_size(matrix_file_header *header, size_t dtype_size, size_t file_size){
+    if(header->nrows <= 0 || header->ncols <= 0 || dtype_size == 0 || 
+        header->data_offset < 0 || (uint64_t)header->data_offset > file_size){
+        return -1;
+    }
+    if((uint64_t)header->nrows > (file_size - header->data_offset)/dtype_size/header->ncols){
+        return -1;
+    }
+    return 0;
+}
+
+
 /* load matrix from binary file 
- * the nonzeros are in order of double loop over rows and columns
-format:
+ * legacy format has the nonzeros in order of double loop over rows and columns:
 num_rows (int) 
 num_columns (int)
 nnz (double)
 ...
 nnz (double)
+ * the self describing format has a matrix_file_header and a 64 byte aligned payload 
+ * in either storage order; the format is detected from the magic bytes.
+ * the file is memory mapped; a column major payload is used as M->d directly 
+ * (copy on write) while a row major payload is reordered straight from 
+ * the page cache into the column major M->d 
 */
 mat * matrix_load_from_binary_file(char *fname){
-    int i, j, num_rows, num_columns, row_num, col_num;
-    double nnz_val;
-    size_t one = 1;
-    FILE *fp;
+    int fd;
+    size_t file_size;
+    struct stat file_stat;
+    char *file_map;
+    double start_time, elapsed_time;
+    matrix_file_header header;
     mat *M;
-    
-    fp = fopen(fname,"r");
-    fread(&num_rows,sizeof(int),one,fp); //read m
-    fread(&num_columns,sizeof(int),one,fp); //read n
-    printf("initializing M of size %d by %d\n", num_rows, num_columns);
-    M = matrix_new(num_rows,num_columns);
+
+    start_time = omp_get_wtime();
+    fd = open(fname, O_RDONLY);
+    if(fd < 0){
+        printf("could not open %s\n", fname);
+        return NULL;
+    }
+    if(fstat(fd, &file_stat) != 0){
+        printf("could not stat %s\n", fname);
+        close(fd);
+        return NULL;
+    }
+    file_size = file_stat.st_size;
+    file_map = (char*)mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file_map == MAP_FAILED){
+        printf("could not map %s\n", fname);
+        return NULL;
+    }
+
+    if(matrix_file_header_from_bytes(file_map, file_size, &header) != 0 || 
+        header.dtype != MATRIX_FILE_DTYPE_FLOAT64 || 
+        header.nrows > INT_MAX || header.ncols > INT_MAX ||
+        matrix_file_check_payload_size(&header, sizeof(double), file_size) != 0){
+        printf("%s is not a supported binary matrix file\n", fname);
+        munmap(file_map, file_size);
+        return NULL;
+    }
+    printf("initializing M of size %d by %d (format version %d)\n", (int)header.nrows, (int)header.ncols, header.version);
+
+    if(header.storage_order == MATRIX_FILE_COL_MAJOR){
+        // payload is already laid out as M->d
+        madvise(file_map, file_size, MADV_WILLNEED);
+        M = malloc(sizeof(mat));
+        M->nrows = header.nrows;
+        M->ncols = header.ncols;
+        M->d = (double*)(file_map + header.data_offset);
+        M->mapping = file_map;
+        M->mapping_length = file_size;
+        elapsed_time = omp_get_wtime() - start_time;
+        printf("mapped %.1f MB in %.3f seconds without copying\n", file_size/1.0e6, elapsed_time);
+        return M;
+    }
+
+    madvise(file_map, file_size, MADV_WILLNEED);
+    M = matrix_new(header.nrows,header.ncols);
     printf("done..\n");
 
-    // read and set elements
-    for(i=0; i<num_rows; i++){
-        for(j=0; j<num_columns; j++){
-            fread(&nnz_val,sizeof(double),one,fp); //read nnz
-            matrix_set_element(M,i,j,nnz_val);
+    // reorder the row major payload into M
+    matrix_set_from_row_major_data(M, (double*)(file_map + header.data_offset));
+    munmap(file_map, file_size);
+
+    elapsed_time = omp_get_wtime() - start_time;
+    printf("loaded %.1f MB in %.3f seconds (%.1f MB/s)\n", file_size/1.0e6, 
+        elapsed_time, file_size/1.0e6/elapsed_time);
+
+    return M;
+}
+
+
+/* fill in header from the first bytes of a binary matrix file;
+ * files without the magic bytes are taken to be in the legacy format */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header){
+    int legacy_dims[2];
+    if(num_bytes >= MATRIX_FILE_HEADER_SIZE && 
+        memcmp(bytes, MATRIX_FILE_MAGIC, sizeof(header->magic)) == 0){
+        memcpy(header, bytes, sizeof(matrix_file_header));
+        // the payload is 64 byte aligned, so that it can be used in place
+        if(header->version > MATRIX_FILE_VERSION || header->data_offset < MATRIX_FILE_HEADER_SIZE || 
+            header->data_offset % 64 != 0){
+            return -1;
         }
+        return 0;
     }
-    fclose(fp);
 
-    return M;
+    if(num_bytes < MATRIX_FILE_LEGACY_HEADER_SIZE){
+        return -1;
+    }
+    memcpy(legacy_dims, bytes, MATRIX_FILE_LEGACY_HEADER_SIZE);
+    memset(header, 0, sizeof(matrix_file_header));
+    memcpy(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic));
+    header->version = 0;
+    header->dtype = MATRIX_FILE_DTYPE_FLOAT64;
+    header->storage_order = MATRIX_FILE_ROW_MAJOR;
+    header->nrows = legacy_dims[0];
+    header->ncols = legacy_dims[1];
+    header->data_offset = MATRIX_FILE_LEGACY_HEADER_SIZE;
+    return (legacy_dims[0] < 0 || legacy_dims[1] < 0) ? -1 : 0;
+}
+
+
+
+/* fill column major M from row major data with a cache blocked transpose;
+ * tiles of TRANSPOSE_BLOCK_SIZE x TRANSPOSE_BLOCK_SIZE are split over the host threads */
+void matrix_set_from_row_major_data(mat *M, double *data){
+    int ib, jb, i, j, imax, jmax, num_row_blocks, num_col_blocks;
+    size_t m, n;
+    m = M->nrows;
+    n = M->ncols;
+    num_row_blocks = (m + TRANSPOSE_BLOCK_SIZE - 1)/TRANSPOSE_BLOCK_SIZE;
+    num_col_blocks = (n + TRANSPOSE_BLOCK_SIZE - 1)/TRANSPOSE_BLOCK_SIZE;
+
+    #pragma omp parallel shared(M,data,m,n,num_row_blocks,num_col_blocks) private(ib,jb,i,j,imax,jmax) 
+    {
+    #pragma omp for collapse(2) schedule(static)
+    for(jb=0; jb<num_col_blocks; jb++){
+        for(ib=0; ib<num_row_blocks; ib++){
+            imax = min((ib+1)*TRANSPOSE_BLOCK_SIZE, m);
+            jmax = min((jb+1)*TRANSPOSE_BLOCK_SIZE, n);
+            for(j=jb*TRANSPOSE_BLOCK_SIZE; j<jmax; j++){
+                for(i=ib*TRANSPOSE_BLOCK_SIZE; i<imax; i++){
+                    M->d[j*m + i] = data[i*n + j];
+                }
+            }
+        }
+    }
+    }
 }
 
 
@@ -350,12 +476,12 @@ double matrix_frobenius_norm(mat *M){
 
 
 
-/* C = A*B ; column major */
+/* C = A*B ; column major ; uses the first C->ncols columns of B */
 void matrix_matrix_mult(mat *A, mat *B, mat *C){
     double alpha, beta;
     alpha = 1.0; beta = 0.0;
     //cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, A->nrows, B->ncols, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    culaDgemm('N', 'N', A->nrows, B->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+    culaDgemm('N', 'N', A->nrows, C->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
 }
 
 
@@ -368,12 +494,12 @@ void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C){
 }
 
 
-/* C = A*B^T ; column major */
+/* C = A*B^T ; column major ; uses the first C->ncols rows of B */
 void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C){
     double alpha, beta;
     alpha = 1.0; beta = 0.0;
     //cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, A->nrows, B->nrows, A->ncols, alpha, A->d, A->ncols, B->d, B->ncols, beta, C->d, C->ncols);
-    culaDgemm('N', 'T', A->nrows, B->nrows, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
+    culaDgemm('N', 'T', A->nrows, C->ncols, A->ncols, alpha, A->d, A->nrows, B->d, B->nrows, beta, C->d, C->nrows);
 }
 
 
@@ -511,6 +637,16 @@ void build_orthonormal_basis_from_mat(mat *A, mat *Q){
 }
 
 
+/* set V to a view of columns j0..j0+ncols-1 of M sharing its storage (no copy) */
+void matrix_columns_view(mat *V, mat *M, int j0, int ncols){
+    V->nrows = M->nrows;
+    V->ncols = ncols;
+    V->d = M->d + ((size_t)j0)*(M->nrows);
+    V->mapping = NULL;
+    V->mapping_length = 0;
+}
+
+
 
 /* Performs [Q,R] = qr(M,'0') compact QR factorization 
 M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
@@ -606,6 +742,8 @@ void form_svd_product_matrix(mat *U, mat *S, mat *V, mat *P){
 
     // form P = U*S*V^T
     matrix_matrix_mult(U,SVt,P);
+
+    matrix_delete(SVt);
 }
 
 
@@ -621,6 +759,7 @@ double get_percent_error_between_two_mats(mat *A, mat *B){
     normA = matrix_frobenius_norm(A);
     normB = matrix_frobenius_norm(B);
     normA_minus_B = matrix_frobenius_norm(A_minus_B);
+    matrix_delete(A_minus_B);
     return 100.0*normA_minus_B/normA;
 }
 
@@ -4,8 +4,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "omp.h"
 
 #include "cula_lapack.h"
@@ -14,10 +20,25 @@
 #define min(x,y) (((x) < (y)) ? (x) : (y))
 #define max(x,y) (((x) > (y)) ? (x) : (y))
 
+#define TRANSPOSE_BLOCK_SIZE 64
+
+/* self describing binary matrix format: a 64 byte header followed by the 
+ * payload at data_offset (a multiple of 64); little endian */
+#define MATRIX_FILE_MAGIC "RSVDMAT"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_HEADER_SIZE 64
+#define MATRIX_FILE_LEGACY_HEADER_SIZE (2*sizeof(int))
+#define MATRIX_FILE_DTYPE_FLOAT64 1
+#define MATRIX_FILE_DTYPE_FLOAT32 2
+#define MATRIX_FILE_ROW_MAJOR 0
+#define MATRIX_FILE_COL_MAJOR 1
+
 
 typedef struct {
     int nrows, ncols;
     double * d;
+    char * mapping; /* file mapping that d points into, NULL if d is allocated */
+    size_t mapping_length;
 } mat;
 
 
@@ -27,6 +48,18 @@ typedef struct {
 } vec;
 
 
+typedef struct {
+    char magic[8];          /* MATRIX_FILE_MAGIC */
+    int32_t version;        /* 0 for legacy files */
+    int32_t dtype;          /* MATRIX_FILE_DTYPE_* */
+    int32_t storage_order;  /* MATRIX_FILE_ROW_MAJOR or MATRIX_FILE_COL_MAJOR */
+    int32_t reserved;
+    int64_t nrows, ncols;
+    int64_t data_offset;    /* byte offset of the payload from start of file */
+    char padding[16];
+} matrix_file_header;
+
+
 /* initialize new matrix and set all entries to zero */
 mat * matrix_new(int nrows, int ncols);
 
@@ -84,17 +117,28 @@ mat * matrix_load_from_text_file(char *fname);
 
 
 /* load matrix from binary file 
- * the nonzeros are in order of double loop over rows and columns
-format:
+ * legacy format has the nonzeros in order of double loop over rows and columns:
 num_rows (int) 
 num_columns (int)
 nnz (double)
 ...
 nnz (double)
+ * the self describing format (see matrix_file_header) is detected from its magic bytes;
+the file is memory mapped and the load bandwidth is reported; column major 
+float64 files are used as M->d directly without a copy
 */
 mat * matrix_load_from_binary_file(char *fname);
 
 
+/* fill in header from the first bytes of a binary matrix file (legacy or new format);
+returns 0 on success */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header);
+
+
+/* fill column major M from row major data with a cache blocked parallel transpose */
+void matrix_set_from_row_major_data(mat *M, double *data);
+
+
 
 /* load vector from file 
 format:
@@ -136,7 +180,8 @@ void initialize_random_matrix(mat *M);
 double matrix_frobenius_norm(mat *M);
 
 
-/* C = A*B ; column major */
+/* C = A*B ; column major 
+ * only the first C->ncols columns of B are used, so products can be truncated without copies */
 void matrix_matrix_mult(mat *A, mat *B, mat *C);
 
 
@@ -144,7 +189,8 @@ void matrix_matrix_mult(mat *A, mat *B, mat *C);
 void matrix_transpose_matrix_mult(mat *A, mat *B, mat *C);
 
 
-/* C = A*B^T ; column major */
+/* C = A*B^T ; column major 
+ * only the first C->ncols rows of B are used, so products can be truncated without copies */
 void matrix_matrix_transpose_mult(mat *A, mat *B, mat *C);
 
 
@@ -202,6 +248,11 @@ end
 void build_orthonormal_basis_from_mat(mat *A, mat *Q);
 
 
+/* set V to a view of columns j0..j0+ncols-1 of M sharing its storage (no copy); 
+ * V is declared on the stack by the caller and is not deleted */
+void matrix_columns_view(mat *V, mat *M, int j0, int ncols);
+
+
 
 /* Performs [Q,R] = qr(M,'0') compact QR factorization 
 M is mxn ; Q is mxn ; R is min(m,n) x min(m,n) */ 
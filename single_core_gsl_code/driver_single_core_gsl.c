@@ -4,14 +4,21 @@
 
 int main (void)
 {
-    int i, j, m, n, k;
-    double percent_error, normM, normU, normS, normV, normP;
+    int i, j, m, n, k, p, estimate_error;
+    double percent_error, normM, normU, normS, normV;
+    double spectral_bound, frobenius_estimate, frobenius_bound;
     time_t start_time, end_time;
     char *mfile = "../data/A_mat1.bin";
 
     // low rank svd rank
     k = 500;
 
+    // oversampling
+    p = 20;
+
+    // 1: estimate the error with 10 random probes instead of computing it
+    estimate_error = 0;
+
     // load matrix
     printf("loading matrix from %s\n", mfile);
     gsl_matrix *M = matrix_load_from_binary_file(mfile);
@@ -24,35 +31,40 @@ int main (void)
     gsl_matrix *V = gsl_matrix_calloc(n,k);
     
     // call random SVD
-    printf("calling random SVD with k = %d..\n", k);
+    printf("calling random SVD with k = %d and oversampling p = %d..\n", k, p);
     time(&start_time);
-    //randomized_low_rank_svd1(M, k, U, S, V);
-    randomized_low_rank_svd2(M, k, U, S, V);
+    //randomized_low_rank_svd1(M, k, p, U, S, V);
+    randomized_low_rank_svd2(M, k, p, U, S, V);
     time(&end_time);
     printf("elapsed time: about %d seconds\n", (int)difftime(end_time,start_time));
 
-    // form product matrix
-    gsl_matrix *P = gsl_matrix_alloc(m,n);
-    form_svd_product_matrix(U,S,V,P);
-
     // get norms of each
     normM = matrix_frobenius_norm(M);
     normU = matrix_frobenius_norm(U);
     normS = matrix_frobenius_norm(S);
     normV = matrix_frobenius_norm(V);
-    normP = matrix_frobenius_norm(P);
-    printf("normM = %f ; normU = %f ; normS = %f ; normV = %f ; normP = %f\n", normM, normU, normS, normV, normP);
+    printf("normM = %f ; normU = %f ; normS = %f ; normV = %f\n", normM, normU, normS, normV);
 
-    // calculate percent error
-    percent_error = get_percent_error_between_two_mats(M,P);
-    printf("percent_error between M and U S V^T = %f\n", percent_error);
+    if(estimate_error){
+        // bounds hold with probability at least 1 - 10^-10 and 1 - 10^-3
+        estimate_svd_error(M, U, S, V, 10, 1e-3, &spectral_bound, &frobenius_estimate, &frobenius_bound);
+        printf("estimated percent_error between M and U S V^T = %f (bound %f), spectral norm of error <= %f\n", 
+            100.0*frobenius_estimate/normM, 100.0*frobenius_bound/normM, spectral_bound);
+    }
+    else{
+        // calculate percent error from panels of M, without forming P = U S V^T
+        percent_error = get_percent_error_of_svd(M,U,S,V);
+        //gsl_matrix *P = gsl_matrix_alloc(m,n);
+        //form_svd_product_matrix(U,S,V,P);
+        //percent_error = get_percent_error_between_two_mats(M,P);
+        printf("percent_error between M and U S V^T = %f\n", percent_error);
+    }
 
     // free matrices
     gsl_matrix_free(M);
     gsl_matrix_free(U);
     gsl_matrix_free(S);
     gsl_matrix_free(V);
-    gsl_matrix_free(P);
 
     return 0;
 }
@@ -2,68 +2,74 @@
 
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(gsl_matrix *M, int k, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V){
-    int i,j,m,n;
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd1(gsl_matrix *M, int k, int p, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V){
+    int i,j,m,n,l;
     double val;
     m = M->size1; n = M->size2;
+    l = k + p;
 
     // build random matrix
     printf("form RN..\n");
-    gsl_matrix *RN = gsl_matrix_calloc(n, k); // calloc sets all elements to zero
+    gsl_matrix *RN = gsl_matrix_calloc(n, l); // calloc sets all elements to zero
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    gsl_matrix *Y = gsl_matrix_alloc(m,k);
+    gsl_matrix *Y = gsl_matrix_alloc(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q..\n");
-    gsl_matrix *Q = gsl_matrix_alloc(m,k);
+    gsl_matrix *Q = gsl_matrix_alloc(m,l);
     QR_factorization_getQ(Y, Q);
 
     
     // build the matrix B B^T = Q^T M M^T Q 
     printf("form BBt..\n");
-    gsl_matrix *B = gsl_matrix_alloc(k,n);
+    gsl_matrix *B = gsl_matrix_alloc(l,n);
     matrix_transpose_matrix_mult(Q,M,B);
 
-    gsl_matrix *Bt = gsl_matrix_alloc(n,k);
+    gsl_matrix *Bt = gsl_matrix_alloc(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);    
 
-    gsl_matrix *BBt = gsl_matrix_alloc(k,k);
+    gsl_matrix *BBt = gsl_matrix_alloc(l,l);
     matrix_matrix_mult(B,Bt,BBt);    
 
 
     // compute eigendecomposition of BBt
     printf("get eigendecomposition of BBt..\n");
-    gsl_vector *evals = gsl_vector_alloc(k);
-    gsl_matrix *Uhat = gsl_matrix_alloc(k, k);
+    gsl_vector *evals = gsl_vector_alloc(l);
+    gsl_matrix *Uhat = gsl_matrix_alloc(l, l);
     compute_evals_and_evecs_of_symm_matrix(BBt, evals, Uhat);
 
+    // eigenvalues are sorted in ascending order, so the top k 
+    // eigenvectors are the last k columns of Uhat
+    gsl_matrix_view Uhat_k = gsl_matrix_submatrix(Uhat, 0, l-k, l, k);
+
 
     // compute singular values and matrix Sigma
     printf("form S..\n");
     gsl_vector *singvals = gsl_vector_alloc(k);
     for(i=0; i<k; i++){
-        gsl_vector_set(singvals,i,sqrt(gsl_vector_get(evals,i)));
+        gsl_vector_set(singvals,i,sqrt(gsl_vector_get(evals,l-k+i)));
     }
     build_diagonal_matrix(singvals, k, S);
     
 
-    // compute U = Q*Uhat mxk * kxk = mxk  
+    // compute U = Q*Uhat_k mxl * lxk = mxk  
     printf("form U..\n");
-    matrix_matrix_mult(Q,Uhat,U);
+    matrix_matrix_mult(Q,&Uhat_k.matrix,U);
 
 
     // compute nxk V 
-    // V = B^T Uhat * Sigma^{-1}
+    // V = B^T Uhat_k * Sigma^{-1}
     printf("form V..\n");
     gsl_matrix *Sinv = gsl_matrix_alloc(k,k);
-    gsl_matrix *UhatSinv = gsl_matrix_alloc(k,k);
+    gsl_matrix *UhatSinv = gsl_matrix_alloc(l,k);
     invert_diagonal_matrix(Sinv,S);
-    matrix_matrix_mult(Uhat,Sinv,UhatSinv);
+    matrix_matrix_mult(&Uhat_k.matrix,Sinv,UhatSinv);
     matrix_matrix_mult(Bt,UhatSinv,V);
 
     // clean up
@@ -77,58 +83,62 @@ void randomized_low_rank_svd1(gsl_matrix *M, int k, gsl_matrix *U, gsl_matrix *S
 }
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR method */
-void randomized_low_rank_svd2(gsl_matrix *M, int k, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V){
-    int i,j,m,n;
+/* computes the approximate low rank SVD of rank k of matrix M using QR method 
+ * with k+p random samples (p is the oversampling) truncated to rank k */
+void randomized_low_rank_svd2(gsl_matrix *M, int k, int p, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V){
+    int i,j,m,n,l;
     double val;
     m = M->size1; n = M->size2;
+    l = k + p;
 
     // build random matrix
     printf("form RN..\n");
-    gsl_matrix *RN = gsl_matrix_calloc(n,k); // calloc sets all elements to zero
+    gsl_matrix *RN = gsl_matrix_calloc(n,l); // calloc sets all elements to zero
     //RN = matrix_load_from_file("data/R.mtx");
     initialize_random_matrix(RN);
 
     // multiply to get matrix of random samples Y
     printf("form Y..\n");
-    gsl_matrix *Y = gsl_matrix_alloc(m,k);
+    gsl_matrix *Y = gsl_matrix_alloc(m,l);
     matrix_matrix_mult(M, RN, Y);
 
     // build Q from Y
     printf("form Q..\n");
-    gsl_matrix *Q = gsl_matrix_alloc(m,k);
+    gsl_matrix *Q = gsl_matrix_alloc(m,l);
     QR_factorization_getQ(Y, Q);
 
-    // form Bt = Mt*Q : nxm * mxk = nxk
+    // form Bt = Mt*Q : nxm * mxl = nxl
     printf("form Bt..\n");
-    gsl_matrix *Bt = gsl_matrix_alloc(n,k);
+    gsl_matrix *Bt = gsl_matrix_alloc(n,l);
     matrix_transpose_matrix_mult(M,Q,Bt);
 
     printf("doing QR..\n");
-    gsl_matrix *Qhat = gsl_matrix_calloc(n,k);
-    gsl_matrix *Rhat = gsl_matrix_calloc(k,k);
+    gsl_matrix *Qhat = gsl_matrix_calloc(n,l);
+    gsl_matrix *Rhat = gsl_matrix_calloc(l,l);
     compute_QR_compact_factorization(Bt,Qhat,Rhat);
 
-    // compute SVD of Rhat (kxk)
+    // compute SVD of Rhat (lxl)
     printf("doing SVD..\n");
-    gsl_matrix *Uhat = gsl_matrix_alloc(k,k);
-    gsl_vector *Sigmahat = gsl_vector_alloc(k);
-    gsl_matrix *Vhat = gsl_matrix_alloc(k,k);
-    gsl_vector *svd_work_vec = gsl_vector_alloc(k);
+    gsl_matrix *Uhat = gsl_matrix_alloc(l,l);
+    gsl_vector *Sigmahat = gsl_vector_alloc(l);
+    gsl_matrix *Vhat = gsl_matrix_alloc(l,l);
+    gsl_vector *svd_work_vec = gsl_vector_alloc(l);
     gsl_matrix_memcpy(Uhat, Rhat);
     gsl_linalg_SV_decomp (Uhat, Vhat, Sigmahat, svd_work_vec);
 
-    // record singular values
+    // record the top k singular values
     printf("form S..\n");
     build_diagonal_matrix(Sigmahat, k, S);
 
-    // U = Q*Vhat
+    // U = Q*Vhat(:,1:k)
     printf("form U..\n");
-    matrix_matrix_mult(Q,Vhat,U);
+    gsl_matrix_view Vhat_k = gsl_matrix_submatrix(Vhat, 0, 0, l, k);
+    matrix_matrix_mult(Q,&Vhat_k.matrix,U);
 
-    // V = Qhat*Uhat
+    // V = Qhat*Uhat(:,1:k)
     printf("form V..\n");
-    matrix_matrix_mult(Qhat,Uhat,V);
+    gsl_matrix_view Uhat_k = gsl_matrix_submatrix(Uhat, 0, 0, l, k);
+    matrix_matrix_mult(Qhat,&Uhat_k.matrix,V);
 
     // free stuff
     gsl_matrix_free(RN);
@@ -1,10 +1,13 @@
 #include "matrix_vector_functions_gsl.h"
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using BBt version */
-void randomized_low_rank_svd1(gsl_matrix *M, int k, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V);
+/* computes the approximate low rank SVD of rank k of matrix M using BBt version; 
+ * the range is sampled with k+p random vectors (p is the oversampling, typically 
+ * 5 to 20) and the result is truncated to rank k */
+void randomized_low_rank_svd1(gsl_matrix *M, int k, int p, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V);
 
 
-/* computes the approximate low rank SVD of rank k of matrix M using QR method */
-void randomized_low_rank_svd2(gsl_matrix *M, int k, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V);
+/* computes the approximate low rank SVD of rank k of matrix M using QR method 
+ * with k+p random samples truncated to rank k */
+void randomized_low_rank_svd2(gsl_matrix *M, int k, int p, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V);
 
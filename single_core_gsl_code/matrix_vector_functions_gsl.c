@@ -67,42 +67,139 @@ gsl_matrix * matrix_load_from_text_file(char *fname){
 
 
 
+/* 0 if the header describes a nonempty payload of dtype_size byte entries that lies 
+ * within a file of file_size bytes, compared without overflow; -1 otherwise */
+static int matrix_file_check_payload_size(matrix_file_header *header, size_t dtype_size, size_t file_size){
+    if(header->nrows <= 0 || header->ncols <= 0 || dtype_size == 0 || 
+        header->data_offset < 0 || (uint64_t)header->data_offset > file_size){
+        return -1;
+    }
+    if((uint64_t)header->nrows > (file_size - header->data_offset)/dtype_size/header->ncols){
+        return -1;
+    }
+    return 0;
+}
+
+
 /* load matrix from binary file 
- * the nonzeros are in order of double loop over rows and columns
-format:
+ * legacy format has the nonzeros in order of double loop over rows and columns:
 num_rows (int) 
 num_columns (int)
 nnz (double)
 ...
 nnz (double)
+ * the self describing format has a matrix_file_header and a 64 byte aligned payload 
+ * in either storage order; the format is detected from the magic bytes.
+ * the file is memory mapped; a row major payload is already in the order of 
+ * gsl_matrix so it is copied over one row at a time, a column major payload 
+ * is transposed in blocks
 */
 gsl_matrix * matrix_load_from_binary_file(char *fname){
-    int i, j, num_rows, num_columns, row_num, col_num;
-    double nnz_val;
-    size_t one = 1;
-    FILE *fp;
+    int i, j, i0, j0, imax, jmax, fd;
+    size_t file_size, num_rows, num_columns;
+    struct stat file_stat;
+    struct timespec start_time, end_time;
+    char *file_map;
+    double *payload, elapsed_time;
+    matrix_file_header header;
     gsl_matrix *M;
     
-    fp = fopen(fname,"r");
-    fread(&num_rows,sizeof(int),one,fp); //read m
-    fread(&num_columns,sizeof(int),one,fp); //read n
-    printf("initializing M of size %d by %d\n", num_rows, num_columns);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    fd = open(fname, O_RDONLY);
+    if(fd < 0){
+        printf("could not open %s\n", fname);
+        return NULL;
+    }
+    if(fstat(fd, &file_stat) != 0){
+        printf("could not stat %s\n", fname);
+        close(fd);
+        return NULL;
+    }
+    file_size = file_stat.st_size;
+    file_map = (char*)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file_map == MAP_FAILED){
+        printf("could not map %s\n", fname);
+        return NULL;
+    }
+
+    if(matrix_file_header_from_bytes(file_map, file_size, &header) != 0 || 
+        header.dtype != MATRIX_FILE_DTYPE_FLOAT64 || 
+        matrix_file_check_payload_size(&header, sizeof(double), file_size) != 0){
+        printf("%s is not a supported binary matrix file\n", fname);
+        munmap(file_map, file_size);
+        return NULL;
+    }
+    madvise(file_map, file_size, MADV_SEQUENTIAL);
+
+    num_rows = header.nrows;
+    num_columns = header.ncols;
+    printf("initializing M of size %d by %d (format version %d)\n", (int)num_rows, (int)num_columns, header.version);
     M = gsl_matrix_alloc(num_rows,num_columns);
     printf("done..\n");
 
-    // read and set elements
-    for(i=0; i<num_rows; i++){
-        for(j=0; j<num_columns; j++){
-            fread(&nnz_val,sizeof(double),one,fp); //read nnz
-            gsl_matrix_set(M,i,j,nnz_val);
+    payload = (double*)(file_map + header.data_offset);
+    if(header.storage_order == MATRIX_FILE_ROW_MAJOR){
+        // copy rows 
+        for(i=0; i<num_rows; i++){
+            memcpy(M->data + i*(M->tda), payload + i*num_columns, num_columns*sizeof(double));
         }
     }
-    fclose(fp);
+    else{
+        // transpose in blocks of TRANSPOSE_BLOCK_SIZE x TRANSPOSE_BLOCK_SIZE
+        for(i0=0; i0<num_rows; i0+=TRANSPOSE_BLOCK_SIZE){
+            for(j0=0; j0<num_columns; j0+=TRANSPOSE_BLOCK_SIZE){
+                imax = min(i0 + TRANSPOSE_BLOCK_SIZE, num_rows);
+                jmax = min(j0 + TRANSPOSE_BLOCK_SIZE, num_columns);
+                for(i=i0; i<imax; i++){
+                    for(j=j0; j<jmax; j++){
+                        M->data[i*(M->tda) + j] = payload[j*num_rows + i];
+                    }
+                }
+            }
+        }
+    }
+    munmap(file_map, file_size);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    elapsed_time = (end_time.tv_sec - start_time.tv_sec) + 1.0e-9*(end_time.tv_nsec - start_time.tv_nsec);
+    printf("loaded %.1f MB in %.3f seconds (%.1f MB/s)\n", file_size/1.0e6, 
+        elapsed_time, file_size/1.0e6/elapsed_time);
 
     return M;
 }
 
 
+/* fill in header from the first bytes of a binary matrix file;
+ * files without the magic bytes are taken to be in the legacy format */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header){
+    int legacy_dims[2];
+    if(num_bytes >= MATRIX_FILE_HEADER_SIZE && 
+        memcmp(bytes, MATRIX_FILE_MAGIC, sizeof(header->magic)) == 0){
+        memcpy(header, bytes, sizeof(matrix_file_header));
+        // the payload is 64 byte aligned, so that it can be used in place
+        if(header->version > MATRIX_FILE_VERSION || header->data_offset < MATRIX_FILE_HEADER_SIZE || 
+            header->data_offset % 64 != 0){
+            return -1;
+        }
+        return 0;
+    }
+
+    if(num_bytes < MATRIX_FILE_LEGACY_HEADER_SIZE){
+        return -1;
+    }
+    memcpy(legacy_dims, bytes, MATRIX_FILE_LEGACY_HEADER_SIZE);
+    memset(header, 0, sizeof(matrix_file_header));
+    memcpy(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic));
+    header->version = 0;
+    header->dtype = MATRIX_FILE_DTYPE_FLOAT64;
+    header->storage_order = MATRIX_FILE_ROW_MAJOR;
+    header->nrows = legacy_dims[0];
+    header->ncols = legacy_dims[1];
+    header->data_offset = MATRIX_FILE_LEGACY_HEADER_SIZE;
+    return (legacy_dims[0] < 0 || legacy_dims[1] < 0) ? -1 : 0;
+}
+
 
 
 
@@ -407,6 +504,7 @@ void form_svd_product_matrix(gsl_matrix *U, gsl_matrix *S, gsl_matrix *V, gsl_ma
     gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, S, V, 0.0, SVt);
     // form P = U*S*V^T
     gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, U, SVt, 0.0, P);
+    gsl_matrix_free(SVt);
 }
 
 
@@ -422,7 +520,141 @@ double get_percent_error_between_two_mats(gsl_matrix *A, gsl_matrix *B){
     normA = matrix_frobenius_norm(A);
     normB = matrix_frobenius_norm(B);
     normA_minus_B = matrix_frobenius_norm(A_minus_B);
+    gsl_matrix_free(A_minus_B);
     return 100.0*normA_minus_B/normA;
 }
 
 
+double get_percent_error_of_svd(gsl_matrix *M, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V){
+    int i,j,m,n,k,i0,nr,nb;
+    double normM_squared, trace, normP_squared, residual_squared, panel_sum, val, c, y, t;
+    m = M->size1; n = M->size2; k = S->size1;
+    nb = min(RESIDUAL_PANEL_ROWS, m);
+    gsl_matrix *T = gsl_matrix_alloc(nb,k);
+    gsl_matrix *C = gsl_matrix_calloc(k,k);
+
+    // C = U^T M V accumulated over row panels: C += U(rows,:)^T (M(rows,:) V)
+    for(i0=0; i0<m; i0+=nb){
+        nr = min(nb, m - i0);
+        gsl_matrix_view Mi = gsl_matrix_submatrix(M, i0, 0, nr, n);
+        gsl_matrix_view Ui = gsl_matrix_submatrix(U, i0, 0, nr, k);
+        gsl_matrix_view Ti = gsl_matrix_submatrix(T, 0, 0, nr, k);
+        gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &Mi.matrix, V, 0.0, &Ti.matrix);
+        gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, &Ui.matrix, &Ti.matrix, 1.0, C);
+    }
+    normM_squared = pow(matrix_frobenius_norm(M),2);
+
+    // tr(S^T C) and norm(U S V^T)^2 = sum((U^T U) .* (S (V^T V) S^T))
+    gsl_matrix *GU = gsl_matrix_alloc(k,k);
+    gsl_matrix *GV = gsl_matrix_alloc(k,k);
+    gsl_matrix *SGV = gsl_matrix_alloc(k,k);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, U, U, 0.0, GU);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, V, V, 0.0, GV);
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, S, GV, 0.0, SGV);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, SGV, S, 0.0, GV);
+    trace = 0; normP_squared = 0;
+    for(i=0; i<k; i++){
+        for(j=0; j<k; j++){
+            trace += gsl_matrix_get(S,i,j)*gsl_matrix_get(C,i,j);
+            normP_squared += gsl_matrix_get(GU,i,j)*gsl_matrix_get(GV,i,j);
+        }
+    }
+    residual_squared = normM_squared - 2*trace + normP_squared;
+
+    if(residual_squared < RESIDUAL_CANCELLATION_TOL*normM_squared){
+        // R = M(rows,:) - (U(rows,:) S) V^T panel by panel, 
+        // with Kahan summation of the panel sums
+        printf("residual is small, summing it explicitly over panels\n");
+        gsl_matrix *R = gsl_matrix_alloc(nb,n);
+        residual_squared = 0; c = 0;
+        for(i0=0; i0<m; i0+=nb){
+            nr = min(nb, m - i0);
+            gsl_matrix_view Mi = gsl_matrix_submatrix(M, i0, 0, nr, n);
+            gsl_matrix_view Ui = gsl_matrix_submatrix(U, i0, 0, nr, k);
+            gsl_matrix_view Ti = gsl_matrix_submatrix(T, 0, 0, nr, k);
+            gsl_matrix_view Ri = gsl_matrix_submatrix(R, 0, 0, nr, n);
+            gsl_matrix_memcpy(&Ri.matrix, &Mi.matrix);
+            gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &Ui.matrix, S, 0.0, &Ti.matrix);
+            gsl_blas_dgemm(CblasNoTrans, CblasTrans, -1.0, &Ti.matrix, V, 1.0, &Ri.matrix);
+
+            panel_sum = 0;
+            for(i=0; i<nr; i++){
+                for(j=0; j<n; j++){
+                    val = gsl_matrix_get(&Ri.matrix, i, j);
+                    panel_sum += val*val;
+                }
+            }
+            y = panel_sum - c;
+            t = residual_squared + y;
+            c = (t - residual_squared) - y;
+            residual_squared = t;
+        }
+        gsl_matrix_free(R);
+    }
+
+    gsl_matrix_free(T);
+    gsl_matrix_free(C);
+    gsl_matrix_free(GU);
+    gsl_matrix_free(GV);
+    gsl_matrix_free(SGV);
+    return 100.0*sqrt(max(residual_squared,0)/normM_squared);
+}
+
+
+void estimate_svd_error(gsl_matrix *M, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V, int r, double delta, double *spectral_bound, double *frobenius_estimate, double *frobenius_bound){
+    int i,j,k;
+    double u1, u2, val, colnorm_squared, max_norm_squared, sum_squares, x, lo, hi;
+    k = S->size1;
+    gsl_matrix *W = gsl_matrix_alloc(M->size2, r);
+    gsl_matrix *Y = gsl_matrix_alloc(M->size1, r);
+    gsl_matrix *T = gsl_matrix_alloc(k, r);
+    gsl_matrix *ST = gsl_matrix_alloc(k, r);
+
+    // Gaussian probes by Box-Muller (initialize_random_matrix is uniform)
+    for(i=0; i<W->size1; i++){
+        for(j=0; j<r; j++){
+            u1 = (rand() + 1.0)/(RAND_MAX + 2.0);
+            u2 = (rand() + 1.0)/(RAND_MAX + 2.0);
+            gsl_matrix_set(W, i, j, sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2));
+        }
+    }
+
+    // E*W = M*W - U*(S*(V^T*W))
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, M, W, 0.0, Y);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, V, W, 0.0, T);
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, S, T, 0.0, ST);
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, U, ST, 1.0, Y);
+
+    max_norm_squared = 0; sum_squares = 0;
+    for(j=0; j<r; j++){
+        colnorm_squared = 0;
+        for(i=0; i<Y->size1; i++){
+            val = gsl_matrix_get(Y, i, j);
+            colnorm_squared += val*val;
+        }
+        max_norm_squared = max(max_norm_squared, colnorm_squared);
+        sum_squares += colnorm_squared;
+    }
+    *spectral_bound = 10.0*sqrt(2.0/M_PI)*sqrt(max_norm_squared);
+    *frobenius_estimate = sqrt(sum_squares/r);
+
+    // (r/2)(log(x) + 1 - x) = log(delta) for x in (0,1) by bisection
+    lo = 0; hi = 1;
+    for(i=0; i<100; i++){
+        x = 0.5*(lo + hi);
+        if(0.5*r*(log(x) + 1 - x) < log(delta)){
+            lo = x;
+        }
+        else{
+            hi = x;
+        }
+    }
+    *frobenius_bound = (*frobenius_estimate)/sqrt(lo);
+
+    gsl_matrix_free(W);
+    gsl_matrix_free(Y);
+    gsl_matrix_free(T);
+    gsl_matrix_free(ST);
+}
+
+
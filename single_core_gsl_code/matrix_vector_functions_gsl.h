@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_eigen.h>
@@ -9,6 +15,36 @@
 #define min(x,y) (((x) < (y)) ? (x) : (y))
 #define max(x,y) (((x) > (y)) ? (x) : (y))
 
+#define TRANSPOSE_BLOCK_SIZE 64
+
+/* rows of M per panel in get_percent_error_of_svd; below a squared relative 
+ * residual of RESIDUAL_CANCELLATION_TOL the residual is summed explicitly */
+#define RESIDUAL_PANEL_ROWS 256
+#define RESIDUAL_CANCELLATION_TOL 1e-6
+
+/* self describing binary matrix format: a 64 byte header followed by the 
+ * payload at data_offset (a multiple of 64); little endian */
+#define MATRIX_FILE_MAGIC "RSVDMAT"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_HEADER_SIZE 64
+#define MATRIX_FILE_LEGACY_HEADER_SIZE (2*sizeof(int))
+#define MATRIX_FILE_DTYPE_FLOAT64 1
+#define MATRIX_FILE_DTYPE_FLOAT32 2
+#define MATRIX_FILE_ROW_MAJOR 0
+#define MATRIX_FILE_COL_MAJOR 1
+
+
+typedef struct {
+    char magic[8];          /* MATRIX_FILE_MAGIC */
+    int32_t version;        /* 0 for legacy files */
+    int32_t dtype;          /* MATRIX_FILE_DTYPE_* */
+    int32_t storage_order;  /* MATRIX_FILE_ROW_MAJOR or MATRIX_FILE_COL_MAJOR */
+    int32_t reserved;
+    int64_t nrows, ncols;
+    int64_t data_offset;    /* byte offset of the payload from start of file */
+    char padding[16];
+} matrix_file_header;
+
 
 /* write matrix to file 
 format:
@@ -34,17 +70,23 @@ gsl_matrix * matrix_load_from_text_file(char *fname);
 
 
 /* load matrix from binary file 
- * the nonzeros are in order of double loop over rows and columns
-format:
+ * legacy format has the nonzeros in order of double loop over rows and columns:
 num_rows (int) 
 num_columns (int)
 nnz (double)
 ...
 nnz (double)
+ * the self describing format (see matrix_file_header) is detected from its magic bytes;
+the file is memory mapped and the load bandwidth is reported
 */
 gsl_matrix * matrix_load_from_binary_file(char *fname);
 
 
+/* fill in header from the first bytes of a binary matrix file (legacy or new format);
+returns 0 on success */
+int matrix_file_header_from_bytes(char *bytes, size_t num_bytes, matrix_file_header *header);
+
+
 
 
 /* load vector from file 
@@ -154,3 +196,18 @@ void form_svd_product_matrix(gsl_matrix *U, gsl_matrix *S, gsl_matrix *V, gsl_ma
 /* calculate percent error between A and B: 100*norm(A - B)/norm(A) */
 double get_percent_error_between_two_mats(gsl_matrix *A, gsl_matrix *B);
 
+
+/* 100*norm(M - U*S*V^T)/norm(M) without forming U*S*V^T: from row panels of M 
+ * via norm(M)^2 - 2 tr(S^T U^T M V) + norm(U S V^T)^2 (from the kxk Gram 
+ * matrices of U and V), summing the residual panels explicitly (compensated) 
+ * when the identity cancels; allocates one panel plus a few kxk matrices */
+double get_percent_error_of_svd(gsl_matrix *M, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V);
+
+
+/* a posteriori estimates of the error E = M - U*S*V^T from r Gaussian probes w_i 
+ * costing M*W plus O((m+n)kr): spectral_bound = 10 sqrt(2/pi) max_i norm(E w_i) 
+ * bounds norm(E)_2 with probability at least 1 - 10^(-r); frobenius_estimate = 
+ * sqrt(mean_i norm(E w_i)^2) estimates norm(E)_F and frobenius_bound bounds it 
+ * with probability at least 1 - delta (see the MKL version) */
+void estimate_svd_error(gsl_matrix *M, gsl_matrix *U, gsl_matrix *S, gsl_matrix *V, int r, double delta, double *spectral_bound, double *frobenius_estimate, double *frobenius_bound);
+